@@ -0,0 +1,230 @@
+/*
+ * ReaKontrol
+ * Benchmark of dispatching commands from the keyboard
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ *
+ * Build and run from the repository root with:
+ * clang++ -std=c++20 -O2 -Isrc check/dispatchBench.cpp -o dispatchBench
+ * ./dispatchBench
+ *
+ * This feeds a dense stream of encoder turns, as sent when several knobs are
+ * turned quickly, with an occasional button press, through:
+ * - switch: a switch over the command, as NiMidiSurface used to do.
+ * - table: a lookup in a dispatch table built by makeDispatchTable.
+ * - coalesced: the table, with encoder turns added up and applied once per
+ *   Run(), as NiMidiSurface does now.
+ * The handlers only count what they're given. They aren't inlined, since the
+ * real handlers are too big for that.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "dispatch.h"
+
+using namespace std;
+
+const unsigned char CMD_PLAY = 0x10;
+const unsigned char CMD_STOP = 0x14;
+const unsigned char CMD_NAV_TRACKS = 0x30;
+const unsigned char CMD_NAV_BANKS = 0x31;
+const unsigned char CMD_KNOB_VOLUME0 = 0x50;
+const unsigned char CMD_KNOB_PAN0 = 0x58;
+const unsigned char CMD_CHANGE_VOLUME = 0x64;
+const unsigned char CMD_CHANGE_PAN = 0x65;
+const unsigned char NUM_SLOTS = 8;
+// The number of events the keyboard sends during a Run().
+const size_t EVENTS_PER_RUN = 32;
+const size_t NUM_EVENTS = 1 << 22;
+
+int convertSignedMidiValue(unsigned char value) {
+	return value >= 64 ? value - 128 : value;
+}
+
+struct Surface {
+	int volumes[NUM_SLOTS] {};
+	int pans[NUM_SLOTS] {};
+	int changes = 0;
+	int buttons = 0;
+
+	[[gnu::noinline]] void onKnobVolume(unsigned char slot, int delta) {
+		this->volumes[slot] += delta;
+	}
+
+	[[gnu::noinline]] void onKnobPan(unsigned char slot, int delta) {
+		this->pans[slot] += delta;
+	}
+
+	[[gnu::noinline]] void onChange(unsigned char slot, int delta) {
+		this->changes += delta;
+	}
+
+	[[gnu::noinline]] void onButton(unsigned char slot, unsigned char value) {
+		this->buttons += value;
+	}
+
+	void dispatchSwitch(unsigned char command, unsigned char value) {
+		switch (command) {
+			case CMD_PLAY:
+			case CMD_STOP:
+			case CMD_NAV_TRACKS:
+			case CMD_NAV_BANKS:
+				this->onButton(0, value);
+				break;
+			case CMD_KNOB_VOLUME0:
+			case CMD_KNOB_VOLUME0 + 1:
+			case CMD_KNOB_VOLUME0 + 2:
+			case CMD_KNOB_VOLUME0 + 3:
+			case CMD_KNOB_VOLUME0 + 4:
+			case CMD_KNOB_VOLUME0 + 5:
+			case CMD_KNOB_VOLUME0 + 6:
+			case CMD_KNOB_VOLUME0 + 7:
+				this->onKnobVolume(command - CMD_KNOB_VOLUME0,
+					convertSignedMidiValue(value));
+				break;
+			case CMD_KNOB_PAN0:
+			case CMD_KNOB_PAN0 + 1:
+			case CMD_KNOB_PAN0 + 2:
+			case CMD_KNOB_PAN0 + 3:
+			case CMD_KNOB_PAN0 + 4:
+			case CMD_KNOB_PAN0 + 5:
+			case CMD_KNOB_PAN0 + 6:
+			case CMD_KNOB_PAN0 + 7:
+				this->onKnobPan(command - CMD_KNOB_PAN0, convertSignedMidiValue(value));
+				break;
+			case CMD_CHANGE_VOLUME:
+			case CMD_CHANGE_PAN:
+				this->onChange(0, convertSignedMidiValue(value));
+				break;
+		}
+	}
+
+	using CcHandler = void (Surface::*)(unsigned char slot, unsigned char value);
+	static constexpr CommandRange<CcHandler> CC_RANGES[] = {
+		{CMD_PLAY, 1, &Surface::onButton},
+		{CMD_STOP, 1, &Surface::onButton},
+		{CMD_NAV_TRACKS, 1, &Surface::onButton},
+		{CMD_NAV_BANKS, 1, &Surface::onButton},
+	};
+	static constexpr DispatchTable<CcHandler> CC_DISPATCH =
+		makeDispatchTable(CC_RANGES);
+	using CcDeltaHandler = void (Surface::*)(unsigned char slot, int delta);
+	static constexpr CommandRange<CcDeltaHandler> CC_DELTA_RANGES[] = {
+		{CMD_KNOB_VOLUME0, NUM_SLOTS, &Surface::onKnobVolume},
+		{CMD_KNOB_PAN0, NUM_SLOTS, &Surface::onKnobPan},
+		{CMD_CHANGE_VOLUME, 1, &Surface::onChange},
+		{CMD_CHANGE_PAN, 1, &Surface::onChange},
+	};
+	static constexpr DispatchTable<CcDeltaHandler> CC_DELTA_DISPATCH =
+		makeDispatchTable(CC_DELTA_RANGES);
+
+	void dispatchTable(unsigned char command, unsigned char value) {
+		const DispatchEntry<CcDeltaHandler>& delta = CC_DELTA_DISPATCH[command];
+		if (delta.handler) {
+			(this->*delta.handler)(delta.slot, convertSignedMidiValue(value));
+			return;
+		}
+		const DispatchEntry<CcHandler>& entry = CC_DISPATCH[command];
+		if (entry.handler) {
+			(this->*entry.handler)(entry.slot, value);
+		}
+	}
+
+	int pendingDeltas[128] {};
+	bool hasPendingDeltas = false;
+
+	void applyPendingDeltas() {
+		if (!this->hasPendingDeltas) {
+			return;
+		}
+		this->hasPendingDeltas = false;
+		for (unsigned char command = 0; command < 128; ++command) {
+			if (this->pendingDeltas[command] != 0) {
+				const DispatchEntry<CcDeltaHandler>& entry = CC_DELTA_DISPATCH[command];
+				(this->*entry.handler)(entry.slot, this->pendingDeltas[command]);
+				this->pendingDeltas[command] = 0;
+			}
+		}
+	}
+
+	void dispatchCoalesced(unsigned char command, unsigned char value) {
+		if (CC_DELTA_DISPATCH[command].handler) {
+			this->pendingDeltas[command] += convertSignedMidiValue(value);
+			this->hasPendingDeltas = true;
+			return;
+		}
+		this->applyPendingDeltas();
+		const DispatchEntry<CcHandler>& entry = CC_DISPATCH[command];
+		if (entry.handler) {
+			(this->*entry.handler)(entry.slot, value);
+		}
+	}
+
+	long long getSum() const {
+		long long sum = this->changes + this->buttons;
+		for (unsigned char slot = 0; slot < NUM_SLOTS; ++slot) {
+			sum += this->volumes[slot] * (slot + 1) + this->pans[slot] * (slot + 9);
+		}
+		return sum;
+	}
+};
+
+struct Event {
+	unsigned char command;
+	unsigned char value;
+};
+
+template<typename Dispatch>
+void run(const char* name, const vector<Event>& events, Dispatch dispatch) {
+	Surface surface;
+	const auto start = chrono::steady_clock::now();
+	for (size_t run = 0; run < events.size(); run += EVENTS_PER_RUN) {
+		for (size_t e = run; e < run + EVENTS_PER_RUN; ++e) {
+			dispatch(surface, events[e]);
+		}
+		// The end of the Run().
+		surface.applyPendingDeltas();
+	}
+	const auto elapsed = chrono::steady_clock::now() - start;
+	// The sum must be the same for every method.
+	printf("%-10s %6.2f ns per event (sum %lld)\n", name,
+		chrono::duration<double, nano>(elapsed).count() / events.size(),
+		surface.getSum());
+}
+
+int main() {
+	vector<Event> events(NUM_EVENTS);
+	unsigned int seed = 1;
+	auto random = [&seed](unsigned int limit) {
+		seed = seed * 1664525 + 1013904223;
+		return (seed >> 8) % limit;
+	};
+	for (Event& event : events) {
+		const unsigned int kind = random(1000);
+		if (kind == 0) {
+			event.command = CMD_PLAY;
+		} else if (kind == 1) {
+			event.command = CMD_NAV_BANKS;
+		} else if (kind < 50) {
+			event.command = random(2) ? CMD_CHANGE_VOLUME : CMD_CHANGE_PAN;
+		} else {
+			// Usually two or three knobs at a time.
+			event.command = (random(2) ? CMD_KNOB_VOLUME0 : CMD_KNOB_PAN0) +
+				random(3);
+		}
+		// Small turns in either direction.
+		event.value = random(2) ? 1 + random(3) : 127 - random(3);
+	}
+	run("switch", events, [](Surface& surface, const Event& event) {
+		surface.dispatchSwitch(event.command, event.value);
+	});
+	run("table", events, [](Surface& surface, const Event& event) {
+		surface.dispatchTable(event.command, event.value);
+	});
+	run("coalesced", events, [](Surface& surface, const Event& event) {
+		surface.dispatchCoalesced(event.command, event.value);
+	});
+	return 0;
+}
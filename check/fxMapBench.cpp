@@ -0,0 +1,107 @@
+/*
+ * ReaKontrol
+ * Benchmark of loading and using FX maps
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ *
+ * Build this with check/regexFxMap.cpp as well as the stub and ReaKontrol
+ * sources.
+ *
+ * RegexFxMap also stores maps in std::map as FxMap used to, so the lookup
+ * times compare that with FxMap's flat arrays.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "fxMap.h"
+#include "reaperStub.h"
+#include "regexFxMap.h"
+
+using namespace std;
+
+const int NUM_PARAMS = 4096;
+const int NUM_LOADS = 20;
+const int NUM_LOOKUP_PASSES = 1000;
+
+// Time how long it takes to load the map, on average.
+template<typename Map>
+void timeLoad(const char* name, MediaTrack* track) {
+	int count = 0;
+	const auto start = chrono::steady_clock::now();
+	for (int load = 0; load < NUM_LOADS; ++load) {
+		const Map map(track, 0);
+		count += map.getParamCount();
+	}
+	const auto elapsed = chrono::steady_clock::now() - start;
+	printf("%-10s load %8.3f ms (%d params)\n", name,
+		chrono::duration<double, milli>(elapsed).count() / NUM_LOADS,
+		count / NUM_LOADS);
+}
+
+// Time the lookups done when showing a page and when a parameter changes,
+// for every parameter in the map.
+template<typename Map>
+void timeLookups(const char* name, MediaTrack* track) {
+	const Map map(track, 0);
+	const int count = map.getParamCount();
+	double sum = 0;
+	const auto start = chrono::steady_clock::now();
+	for (int pass = 0; pass < NUM_LOOKUP_PASSES; ++pass) {
+		for (int rp = 0; rp < NUM_PARAMS; ++rp) {
+			sum += map.getMapParam(rp);
+		}
+		for (int mp = 0; mp < count; ++mp) {
+			sum += map.getReaperParam(mp) + map.getParamMultiplier(mp) +
+				map.hasParamName(mp);
+		}
+	}
+	const auto elapsed = chrono::steady_clock::now() - start;
+	// The sum stops the compiler from dropping the work. It must be the same for
+	// both maps.
+	printf("%-10s lookups %8.2f ns per param (sum %.0f)\n", name,
+		chrono::duration<double, nano>(elapsed).count() /
+			(NUM_LOOKUP_PASSES * (NUM_PARAMS + count)), sum);
+}
+
+int main() {
+	const filesystem::path resourcePath =
+		filesystem::temp_directory_path() / "reaKontrolFxMapBench";
+	const filesystem::path dir = resourcePath / "reaKontrol" / "fxMaps";
+	filesystem::create_directories(dir);
+	initStubReaper(1, NUM_PARAMS, resourcePath.string());
+	MediaTrack* track = CSurf_TrackFromID(1, false);
+	// A large map, like those generated for big synths, with a section and a
+	// page break every 8 parameters.
+	int numLines = 0;
+	{
+		ofstream output(dir / "VST Stub (ReaKontrol).rkfm");
+		output << "# Generated map\nBig Synth:\n";
+		for (int p = 0; p < NUM_PARAMS; ++p) {
+			if (p % 8 == 0) {
+				output << "\n[Section " << p / 8 << "]\n";
+				numLines += 2;
+			}
+			output << p;
+			if (p % 3 == 0) {
+				output << " /2";
+			}
+			output << " Param " << p << " # from the FX\n";
+			++numLines;
+			if (p % 8 == 6) {
+				output << "---\n";
+				++numLines;
+			}
+		}
+	}
+	printf("map with %d lines\n", numLines);
+	timeLoad<RegexFxMap>("regex", track);
+	timeLoad<FxMap>("FxMap", track);
+	timeLookups<RegexFxMap>("regex", track);
+	timeLookups<FxMap>("FxMap", track);
+	filesystem::remove_all(resourcePath);
+	return 0;
+}
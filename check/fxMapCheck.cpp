@@ -0,0 +1,165 @@
+/*
+ * ReaKontrol
+ * Check that FX maps load the same as they did with regular expressions
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ *
+ * Build this with check/regexFxMap.cpp as well as the stub and ReaKontrol
+ * sources.
+ */
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "fxMap.h"
+#include "reaperStub.h"
+#include "regexFxMap.h"
+
+using namespace std;
+
+const int NUM_PARAMS = 64;
+const int NUM_MAPS = 3000;
+
+static int numFailures = 0;
+static int numMapFailures = 0;
+static unsigned int seed = 1;
+
+static unsigned int random(unsigned int limit) {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) % limit;
+}
+
+static const char* pick(initializer_list<const char*> choices) {
+	return choices.begin()[random(choices.size())];
+}
+
+// A line which is mostly valid, since most lines in real maps are.
+static string makeValidLine() {
+	switch (random(5)) {
+		case 0:
+			return string(pick({"", " ", "\t"})) + "My Map" +
+				pick({":", "::", ": # name", ":x"});
+		case 1:
+			return "[" + string(pick({"Osc", "Filter", "Env 1", "a]b"})) + "]" +
+				pick({"", " # section", "]"});
+		case 2:
+			return pick({"---", " --- ", "--- # page"});
+		default: {
+			// Include parameters the FX doesn't have and some which are too big
+			// to index.
+			string line = random(20) == 0 ? pick({"70000", "123456789"}) :
+				to_string(random(NUM_PARAMS * 2));
+			line += pick({"", " /2", " *4", "\t/10", " / 3", " /0", " *"});
+			line += pick({"", " Cutoff", "  Res  ", "\tGain # dB", " #", " 5 x"});
+			return line;
+		}
+	}
+}
+
+// A line built from pieces which are significant to the parser, which is more
+// likely to find unusual lines which parse differently.
+static string makeRandomLine() {
+	string line;
+	for (unsigned int n = random(10); n > 0; --n) {
+		line += pick({" ", "\t", "\r", "\v", "\f", "#", ":", "[", "]", "/", "*",
+			"-", "---", "0", "7", "42", "a", "Bc"});
+	}
+	return line;
+}
+
+static string makeMapFile() {
+	string contents;
+	for (unsigned int n = random(40); n > 0; --n) {
+		contents += random(3) == 0 ? makeRandomLine() : makeValidLine();
+		contents += pick({"\n", "\n", "\r\n", "\n\n"});
+	}
+	// Sometimes leave the last line unterminated.
+	if (random(2) == 0) {
+		contents += makeValidLine();
+	}
+	return contents;
+}
+
+static void fail(const string& message) {
+	if (numMapFailures == 0) {
+		printf("%s\n", message.c_str());
+	}
+	++numMapFailures;
+}
+
+template<typename Value>
+static void compare(const char* getter, int arg, Value fast, Value regex) {
+	if (fast != regex) {
+		fail(string(getter) + "(" + to_string(arg) + ") differs");
+	}
+}
+
+static void checkMap(MediaTrack* track, const string& contents) {
+	const FxMap fast(track, 0);
+	const RegexFxMap regex(track, 0);
+	numMapFailures = 0;
+	if (fast.getMapName() != regex.getMapName()) {
+		fail("getMapName differs: " + fast.getMapName() + ", " +
+			regex.getMapName());
+	}
+	if (FxMap::getMapNameFor(track, 0) != RegexFxMap::getMapNameFor(track, 0)) {
+		fail("getMapNameFor differs");
+	}
+	const int count = fast.getParamCount();
+	compare("getParamCount", 0, count, regex.getParamCount());
+	for (int mp = 0; mp < count; ++mp) {
+		compare("getReaperParam", mp, fast.getReaperParam(mp),
+			regex.getReaperParam(mp));
+		compare("getParamName", mp, fast.getParamName(mp), regex.getParamName(mp));
+		compare("hasParamName", mp, fast.hasParamName(mp), regex.hasParamName(mp));
+		compare("getParamMultiplier", mp, fast.getParamMultiplier(mp),
+			regex.getParamMultiplier(mp));
+		compare("getSection", mp, fast.getSection(mp), regex.getSection(mp));
+		compare("getSectionsForPage", mp, fast.getSectionsForPage(mp),
+			regex.getSectionsForPage(mp));
+	}
+	// A section after the last parameter.
+	compare("getSection", count, fast.getSection(count), regex.getSection(count));
+	for (int rp = -1; rp <= NUM_PARAMS * 2; ++rp) {
+		compare("getMapParam", rp, fast.getMapParam(rp), regex.getMapParam(rp));
+	}
+	for (int rp : {70000, 123456789}) {
+		compare("getMapParam", rp, fast.getMapParam(rp), regex.getMapParam(rp));
+	}
+	if (numMapFailures > 0) {
+		printf("in map:\n%s\n--\n", contents.c_str());
+		++numFailures;
+	}
+}
+
+int main() {
+	const filesystem::path resourcePath =
+		filesystem::temp_directory_path() / "reaKontrolFxMapCheck";
+	const filesystem::path dir = resourcePath / "reaKontrol" / "fxMaps";
+	filesystem::create_directories(dir);
+	initStubReaper(1, NUM_PARAMS, resourcePath.string());
+	MediaTrack* track = CSurf_TrackFromID(1, false);
+	// This is the stub FX name without the characters which can't be used in
+	// file names.
+	const filesystem::path file = dir / "VST Stub (ReaKontrol).rkfm";
+	// Without a map file, both use the FX's own parameters.
+	filesystem::remove(file);
+	checkMap(track, "");
+	for (int m = 0; m < NUM_MAPS; ++m) {
+		const string contents = makeMapFile();
+		{
+			ofstream output(file, ios::binary);
+			output << contents;
+		}
+		checkMap(track, contents);
+	}
+	filesystem::remove_all(resourcePath);
+	if (numFailures > 0) {
+		printf("%d of %d maps differ\n", numFailures, NUM_MAPS);
+		return 1;
+	}
+	printf("%d maps load the same as with regular expressions\n", NUM_MAPS);
+	return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * ReaKontrol
+ * Check that sending to the device doesn't allocate once the output queue has
+ * grown to fit a bank refresh
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include "reaperStub.h"
+
+using namespace std;
+
+static bool isCounting = false;
+static uint64_t numAllocations = 0;
+
+// The other forms of new call this one.
+void* operator new(size_t size) {
+	if (isCounting) {
+		++numAllocations;
+	}
+	if (void* p = malloc(size ? size : 1)) {
+		return p;
+	}
+	throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept {
+	free(p);
+}
+
+const unsigned char MIDI_CC = 0xBF;
+const unsigned char CMD_HELLO = 0x01;
+const unsigned char CMD_NAV_BANKS = 0x31;
+const int NUM_WARM_UP_PASSES = 4;
+const int NUM_PASSES = 100;
+
+// Move to the next or previous bank, which sends names, values and lights for
+// all 8 slots.
+static void switchBank(IReaperControlSurface* surface, bool next) {
+	// Queuing input allocates in the stub, so don't count it.
+	stubMidiIn({MIDI_CC, CMD_NAV_BANKS, (unsigned char)(next ? 1 : 127)});
+	isCounting = numAllocations != SIZE_MAX;
+	surface->Run();
+	isCounting = false;
+}
+
+int main() {
+	const int numTracks = 64;
+	initStubReaper(numTracks, 32);
+	// Give each track different state, so that switching banks changes
+	// everything the device shows.
+	for (int id = 1; id <= numTracks; ++id) {
+		StubTrack& track = getStubTrack(id);
+		track.volume = (double)id / numTracks;
+		track.pan = (double)(id % 9 - 4) / 4;
+		track.muted = id % 2;
+		track.soloed = id % 3 == 0;
+		track.armed = id % 4 == 0;
+	}
+	unique_ptr<IReaperControlSurface> surface(createNiMidiSurface(0, 0));
+	// Acknowledge the surface's hello, which makes it send the first bank.
+	stubMidiIn({MIDI_CC, CMD_HELLO, 4});
+	surface->Run();
+	for (int pass = 0; pass < NUM_WARM_UP_PASSES; ++pass) {
+		switchBank(surface.get(), true);
+		switchBank(surface.get(), false);
+	}
+	numAllocations = 0;
+	const uint64_t startMessages = stubMidiOut.messages;
+	for (int pass = 0; pass < NUM_PASSES; ++pass) {
+		switchBank(surface.get(), true);
+		switchBank(surface.get(), false);
+	}
+	const uint64_t messages = stubMidiOut.messages - startMessages;
+	printf("%d bank refreshes sent %llu messages with %llu allocations\n",
+		NUM_PASSES * 2, (unsigned long long)messages,
+		(unsigned long long)numAllocations);
+	if (messages == 0) {
+		printf("no messages were sent\n");
+		return 1;
+	}
+	return numAllocations == 0 ? 0 : 1;
+}
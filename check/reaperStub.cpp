@@ -0,0 +1,343 @@
+/*
+ * ReaKontrol
+ * Stub REAPER API for checks code
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "reaperStub.h"
+
+using namespace std;
+
+StubMidiOut stubMidiOut;
+
+static vector<StubTrack> tracks;
+static vector<GUID> fxGuids;
+static string resourcePath;
+static int metronome = 0;
+
+class StubEventList: public MIDI_eventlist {
+	public:
+	void AddItem(MIDI_event_t* event) final {
+		this->_events.emplace_back((unsigned char*)event,
+			(unsigned char*)event->midi_message + max(event->size, 4));
+	}
+
+	MIDI_event_t* EnumItems(int* pos) final {
+		if (*pos >= (int)this->_events.size()) {
+			return nullptr;
+		}
+		return (MIDI_event_t*)this->_events[(*pos)++].data();
+	}
+
+	void DeleteItem(int pos) final {}
+
+	int GetSize() final {
+		return 0;
+	}
+
+	void Empty() final {
+		this->_events.clear();
+	}
+
+	void swap(StubEventList& other) {
+		this->_events.swap(other._events);
+	}
+
+	private:
+	vector<vector<unsigned char>> _events;
+};
+
+class StubMidiInput: public midi_Input {
+	public:
+	void start() final {}
+	void stop() final {}
+
+	void SwapBufs(unsigned int timestamp) final {
+		this->_read.swap(this->_pending);
+		this->_pending.Empty();
+	}
+
+	MIDI_eventlist* GetReadBuf() final {
+		return &this->_read;
+	}
+
+	void add(MIDI_event_t* event) {
+		this->_pending.AddItem(event);
+	}
+
+	private:
+	StubEventList _pending;
+	StubEventList _read;
+};
+
+class StubMidiOutput: public midi_Output {
+	public:
+	void SendMsg(MIDI_event_t* msg, int frame_offset) final {
+		++stubMidiOut.messages;
+		stubMidiOut.bytes += msg->size;
+		if (stubMidiOut.isKeepingMessages) {
+			stubMidiOut.kept.emplace_back(msg->midi_message,
+				msg->midi_message + msg->size);
+		}
+	}
+
+	void Send(unsigned char status, unsigned char d1, unsigned char d2,
+		int frame_offset
+	) final {
+		unsigned char buf[sizeof(MIDI_event_t)] = {};
+		auto event = (MIDI_event_t*)buf;
+		event->size = 3;
+		event->midi_message[0] = status;
+		event->midi_message[1] = d1;
+		event->midi_message[2] = d2;
+		this->SendMsg(event, frame_offset);
+	}
+};
+
+static StubMidiInput* midiInput = nullptr;
+
+static StubTrack& getTrack(MediaTrack* track) {
+	return *(StubTrack*)track;
+}
+
+static int getTrackId(MediaTrack* track) {
+	const ptrdiff_t id = (StubTrack*)track - tracks.data();
+	return id >= 0 && id < (ptrdiff_t)tracks.size() ? (int)id : -1;
+}
+
+void initStubReaper(int numTracks, int numParams, const string& path) {
+	tracks.assign(numTracks + 1, {});
+	fxGuids.assign(numTracks + 1, {});
+	for (int id = 0; id <= numTracks; ++id) {
+		tracks[id].name = id == 0 ? "MASTER" : "Track " + to_string(id);
+		tracks[id].params.assign(numParams, 0.5);
+		memcpy(&fxGuids[id], &id, sizeof(id));
+	}
+	resourcePath = path;
+
+	ShowConsoleMsg = [](const char* msg) {
+		fputs(msg, stdout);
+	};
+	GetResourcePath = []() {
+		return resourcePath.c_str();
+	};
+	GetExtState = [](const char* section, const char* key) {
+		return "";
+	};
+	SetExtState = [](const char* section, const char* key, const char* value,
+		bool persist) {};
+	GetNumMIDIInputs = []() {
+		return 1;
+	};
+	GetNumMIDIOutputs = []() {
+		return 1;
+	};
+	CreateMIDIInput = [](int dev) -> midi_Input* {
+		if (dev != 0) {
+			return nullptr;
+		}
+		return midiInput = new StubMidiInput();
+	};
+	CreateMIDIOutput = [](int dev, bool streamMode, int* msOffset100) ->
+		midi_Output* {
+		if (dev != 0) {
+			return nullptr;
+		}
+		return new StubMidiOutput();
+	};
+
+	GetNumTracks = []() {
+		return (int)tracks.size() - 1;
+	};
+	CSurf_NumTracks = [](bool mcpView) {
+		return (int)tracks.size() - 1;
+	};
+	CSurf_TrackFromID = [](int id, bool mcpView) -> MediaTrack* {
+		if (id < 0 || id >= (int)tracks.size()) {
+			return nullptr;
+		}
+		return (MediaTrack*)&tracks[id];
+	};
+	CSurf_TrackToID = [](MediaTrack* track, bool mcpView) {
+		return getTrackId(track);
+	};
+	GetSetMediaTrackInfo = [](MediaTrack* track, const char* name,
+		void* setNewValue) -> void* {
+		StubTrack& t = getTrack(track);
+		if (strcmp(name, "P_NAME") == 0) {
+			return (void*)t.name.c_str();
+		} else if (strcmp(name, "I_SELECTED") == 0) {
+			return &t.selected;
+		} else if (strcmp(name, "I_SOLO") == 0) {
+			return &t.soloed;
+		} else if (strcmp(name, "B_MUTE") == 0) {
+			return &t.muted;
+		} else if (strcmp(name, "I_RECARM") == 0) {
+			return &t.armed;
+		} else if (strcmp(name, "D_VOL") == 0) {
+			return &t.volume;
+		} else if (strcmp(name, "D_PAN") == 0) {
+			return &t.pan;
+		}
+		return nullptr;
+	};
+	SetOnlyTrackSelected = [](MediaTrack* track) {
+		for (StubTrack& t : tracks) {
+			t.selected = &t == &getTrack(track);
+		}
+	};
+	Track_GetPeakInfo = [](MediaTrack* track, int channel) {
+		return getTrack(track).volume / 2;
+	};
+	mkvolstr = [](char* str, double volume) {
+		if (volume < 0.0000000298023223876953125) {
+			strcpy(str, "-inf dB");
+		} else {
+			snprintf(str, 64, "%+.2f dB", log10(volume) * 20);
+		}
+	};
+	mkpanstr = [](char* str, double pan) {
+		if (fabs(pan) < 0.005) {
+			strcpy(str, "center");
+		} else {
+			snprintf(str, 64, "%d%%%c", (int)(fabs(pan) * 100 + 0.5),
+				pan < 0 ? 'L' : 'R');
+		}
+	};
+	DB2SLIDER = [](double db) {
+		// A stand-in with REAPER's range; see volToCcCheck.cpp.
+		db = max(min(db, 12.0), -150.0);
+		return 1000.0 * pow((db + 150.0) / 162.0, 4.33);
+	};
+
+	CSurf_OnVolumeChange = [](MediaTrack* track, double volume, bool relative) {
+		StubTrack& t = getTrack(track);
+		t.volume = relative ? t.volume + volume : volume;
+		return t.volume;
+	};
+	CSurf_OnPanChange = [](MediaTrack* track, double pan, bool relative) {
+		StubTrack& t = getTrack(track);
+		t.pan = max(min(relative ? t.pan + pan : pan, 1.0), -1.0);
+		return t.pan;
+	};
+	CSurf_OnMuteChange = [](MediaTrack* track, int mute) {
+		StubTrack& t = getTrack(track);
+		t.muted = mute < 0 ? !t.muted : mute;
+		return t.muted;
+	};
+	CSurf_OnSoloChange = [](MediaTrack* track, int solo) {
+		StubTrack& t = getTrack(track);
+		t.soloed = solo < 0 ? !t.soloed : solo;
+		return (bool)t.soloed;
+	};
+	// Real REAPER calls back into the surfaces here, but the checks only have an
+	// unregistered surface.
+	CSurf_SetSurfaceVolume = [](MediaTrack* track, double volume,
+		IReaperControlSurface* ignoreSurface) {};
+	CSurf_SetSurfacePan = [](MediaTrack* track, double pan,
+		IReaperControlSurface* ignoreSurface) {};
+	CSurf_SetSurfaceMute = [](MediaTrack* track, bool mute,
+		IReaperControlSurface* ignoreSurface) {};
+	CSurf_SetSurfaceSolo = [](MediaTrack* track, bool solo,
+		IReaperControlSurface* ignoreSurface) {};
+	CSurf_OnPlay = []() {};
+	CSurf_OnStop = []() {};
+	CSurf_OnRecord = []() {};
+	CSurf_GoStart = []() {};
+	CSurf_OnTempoChange = [](double bpm) {};
+	GetPlayState = []() {
+		return 0;
+	};
+	Main_OnCommand = [](int command, int flag) {};
+	projectconfig_var_getoffs = [](const char* name, int* size) {
+		*size = sizeof(metronome);
+		return 0;
+	};
+	projectconfig_var_addr = [](ReaProject* project, int index) -> void* {
+		return &metronome;
+	};
+
+	TrackFX_GetCount = [](MediaTrack* track) {
+		return 1;
+	};
+	TrackFX_GetFXName = [](MediaTrack* track, int fx, char* buf, int bufSize) {
+		if (fx != 0) {
+			buf[0] = '\0';
+			return false;
+		}
+		snprintf(buf, bufSize, "VST: Stub (ReaKontrol)");
+		return true;
+	};
+	TrackFX_GetFXGUID = [](MediaTrack* track, int fx) -> GUID* {
+		return fx == 0 ? &fxGuids[getTrackId(track)] : nullptr;
+	};
+	TrackFX_GetNumParams = [](MediaTrack* track, int fx) {
+		return (int)getTrack(track).params.size();
+	};
+	TrackFX_GetParamName = [](MediaTrack* track, int fx, int param, char* buf,
+		int bufSize) {
+		snprintf(buf, bufSize, "Param %d", param + 1);
+		return true;
+	};
+	TrackFX_GetParamNormalized = [](MediaTrack* track, int fx, int param) {
+		return getTrack(track).params[param];
+	};
+	TrackFX_SetParamNormalized = [](MediaTrack* track, int fx, int param,
+		double value) {
+		getTrack(track).params[param] = value;
+		return true;
+	};
+	TrackFX_FormatParamValueNormalized = [](MediaTrack* track, int fx,
+		int param, double value, char* buf, int bufSize) {
+		snprintf(buf, bufSize, "%.1f%%", value * 100);
+		return true;
+	};
+	TrackFX_GetParameterStepSizes = [](MediaTrack* track, int fx, int param,
+		double* step, double* smallStep, double* largeStep, bool* isToggle) {
+		if (isToggle) {
+			*isToggle = false;
+		}
+		return false;
+	};
+	TrackFX_GetParamFromIdent = [](MediaTrack* track, int fx,
+		const char* ident) {
+		return -1;
+	};
+	TrackFX_GetNamedConfigParm = [](MediaTrack* track, int fx,
+		const char* name, char* buf, int bufSize) {
+		return false;
+	};
+	TrackFX_GetPresetIndex = [](MediaTrack* track, int fx, int* numPresets) {
+		*numPresets = 0;
+		return -1;
+	};
+	TrackFX_GetPreset = [](MediaTrack* track, int fx, char* presetName,
+		int presetNameSize) {
+		presetName[0] = '\0';
+		return false;
+	};
+	TrackFX_NavigatePresets = [](MediaTrack* track, int fx, int presetMove) {
+		return false;
+	};
+}
+
+StubTrack& getStubTrack(int id) {
+	return tracks[id];
+}
+
+void stubMidiIn(span<const unsigned char> message) {
+	vector<unsigned char> buf(sizeof(MIDI_event_t) + message.size());
+	auto event = (MIDI_event_t*)buf.data();
+	event->size = message.size();
+	copy(message.begin(), message.end(), event->midi_message);
+	midiInput->add(event);
+}
+
+void stubMidiIn(initializer_list<unsigned char> message) {
+	stubMidiIn(span<const unsigned char>(message.begin(), message.size()));
+}
@@ -0,0 +1,54 @@
+/*
+ * ReaKontrol
+ * Stub REAPER API for checks header
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <vector>
+#include "reaKontrol.h"
+
+// A track in the stub project. The MediaTrack pointers ReaKontrol gets point
+// at these.
+struct StubTrack {
+	std::string name;
+	double volume = 1.0;
+	double pan = 0.0;
+	int selected = 0;
+	int soloed = 0;
+	int armed = 0;
+	bool muted = false;
+	// The parameters of the track's only FX.
+	std::vector<double> params;
+};
+
+// Implement the REAPER API functions ReaKontrol uses, backed by a project with
+// the master and numTracks tracks, each of which has one FX with numParams
+// parameters. MIDI device 0 is a stub keyboard; see stubMidiIn and
+// stubMidiOut. Other devices don't exist. resourcePath is returned by
+// GetResourcePath.
+void initStubReaper(int numTracks, int numParams,
+	const std::string& resourcePath = ".");
+StubTrack& getStubTrack(int id);
+
+// Queue a message from the stub keyboard. The surface gets it in its next
+// Run().
+void stubMidiIn(std::initializer_list<unsigned char> message);
+void stubMidiIn(std::span<const unsigned char> message);
+
+// What the surface sent to the stub keyboard. Counting doesn't allocate.
+// Messages are only kept if isKeepingMessages is true.
+struct StubMidiOut {
+	uint64_t messages = 0;
+	uint64_t bytes = 0;
+	bool isKeepingMessages = false;
+	std::vector<std::vector<unsigned char>> kept;
+};
+extern StubMidiOut stubMidiOut;
@@ -0,0 +1,135 @@
+/*
+ * ReaKontrol
+ * Check that replaying a MIDI capture has the same effect on the project as
+ * the original input
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ *
+ * This runs against the stub REAPER API, so unlike the replay action, it can't
+ * change a real project.
+ */
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include "midiCapture.h"
+#include "reaperStub.h"
+
+using namespace std;
+
+const unsigned char MIDI_CC = 0xBF;
+const unsigned char CMD_HELLO = 0x01;
+const unsigned char CMD_NAV_BANKS = 0x31;
+const unsigned char CMD_TRACK_MUTED = 0x43;
+const unsigned char CMD_TRACK_SOLOED = 0x44;
+const unsigned char CMD_KNOB_VOLUME0 = 0x50;
+const unsigned char CMD_KNOB_PAN0 = 0x58;
+const int NUM_TRACKS = 24;
+
+using Message = vector<unsigned char>;
+
+// The messages the keyboard sends in each Run().
+const vector<vector<Message>> RUNS = {
+	{{MIDI_CC, CMD_HELLO, 4}},
+	// Turn two knobs, a few steps at a time.
+	{{MIDI_CC, CMD_KNOB_VOLUME0, 3}, {MIDI_CC, CMD_KNOB_VOLUME0, 3},
+		{MIDI_CC, CMD_KNOB_PAN0 + 1, 126}},
+	{{MIDI_CC, CMD_KNOB_VOLUME0, 125}},
+	{{MIDI_CC, CMD_TRACK_MUTED, 0}, {MIDI_CC, CMD_TRACK_SOLOED, 2}},
+	{{MIDI_CC, CMD_NAV_BANKS, 1}},
+	{{MIDI_CC, CMD_KNOB_VOLUME0 + 2, 125}, {MIDI_CC, CMD_KNOB_PAN0 + 7, 5},
+		{MIDI_CC, CMD_TRACK_MUTED, 3}},
+	{{MIDI_CC, CMD_NAV_BANKS, 1}, {MIDI_CC, CMD_TRACK_SOLOED, 7}},
+	{{MIDI_CC, CMD_NAV_BANKS, 127}},
+	{{MIDI_CC, CMD_TRACK_MUTED, 3}, {MIDI_CC, CMD_KNOB_VOLUME0 + 1, 10}},
+};
+
+// Give each track different state, so a change to the wrong track shows up.
+static void initProject() {
+	initStubReaper(NUM_TRACKS, 8);
+	for (int id = 1; id <= NUM_TRACKS; ++id) {
+		StubTrack& track = getStubTrack(id);
+		track.volume = 0.5 + (double)id / NUM_TRACKS;
+		track.pan = (double)(id % 5 - 2) / 4;
+	}
+}
+
+static vector<StubTrack> getProject() {
+	vector<StubTrack> tracks;
+	for (int id = 0; id <= NUM_TRACKS; ++id) {
+		tracks.push_back(getStubTrack(id));
+	}
+	return tracks;
+}
+
+int main() {
+	const filesystem::path path =
+		filesystem::temp_directory_path() / "reaKontrolReplayCheck.rkmc";
+	// Send the messages to a surface connected to the stub keyboard, capturing
+	// them as the capture action would.
+	initProject();
+	const vector<StubTrack> before = getProject();
+	{
+		MidiCapture capture;
+		if (!capture.start(path)) {
+			printf("couldn't create %s\n", path.string().c_str());
+			return 1;
+		}
+		unique_ptr<IReaperControlSurface> surface(createNiMidiSurface(0, 0));
+		for (const vector<Message>& run : RUNS) {
+			for (const Message& message : run) {
+				vector<unsigned char> buf(sizeof(MIDI_event_t) + message.size());
+				auto event = (MIDI_event_t*)buf.data();
+				event->size = message.size();
+				copy(message.begin(), message.end(), event->midi_message);
+				capture.write(CAPTURE_IN, event);
+				stubMidiIn(message);
+			}
+			surface->Run();
+			capture.write(CAPTURE_RUN);
+		}
+		capture.stop();
+	}
+	const vector<StubTrack> live = getProject();
+	// Replay the capture on a fresh copy of the project, as the replay action
+	// does.
+	initProject();
+	{
+		unique_ptr<IReaperControlSurface> offline(createNiMidiSurface(-1, -1));
+		static_cast<BaseSurface*>(offline.get())->replayCapture(path);
+	}
+	const vector<StubTrack> replayed = getProject();
+	filesystem::remove(path);
+	int numChanged = 0;
+	int numFailures = 0;
+	for (int id = 0; id <= NUM_TRACKS; ++id) {
+		const StubTrack& l = live[id];
+		const StubTrack& r = replayed[id];
+		const StubTrack& b = before[id];
+		if (l.volume != b.volume || l.pan != b.pan || l.muted != b.muted ||
+				l.soloed != b.soloed) {
+			++numChanged;
+		}
+		if (l.volume != r.volume || l.pan != r.pan || l.muted != r.muted ||
+				l.soloed != r.soloed || l.selected != r.selected) {
+			printf("track %d: live volume %g pan %g muted %d soloed %d selected %d, "
+				"replayed volume %g pan %g muted %d soloed %d selected %d\n", id,
+				l.volume, l.pan, l.muted, l.soloed, l.selected, r.volume, r.pan,
+				r.muted, r.soloed, r.selected);
+			++numFailures;
+		}
+	}
+	// If the input didn't change anything, the check proves nothing.
+	if (numChanged == 0) {
+		printf("the input didn't change the project\n");
+		return 1;
+	}
+	if (numFailures > 0) {
+		printf("%d tracks differ after replay\n", numFailures);
+		return 1;
+	}
+	printf("replay changed the same %d tracks as the live input\n", numChanged);
+	return 0;
+}
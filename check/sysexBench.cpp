@@ -0,0 +1,121 @@
+/*
+ * ReaKontrol
+ * Benchmark of parsing sysex from the device
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ *
+ * Build and run from the repository root with:
+ * clang++ -std=c++20 -O2 -Isrc check/sysexBench.cpp src/niSysex.cpp -o sysexBench
+ * ./sysexBench
+ *
+ * This parses a stream of the sysex messages the device sends: high
+ * resolution knob turns, tempo changes and plug-in selections. It compares
+ * parseSysex with the old parsing, which read the message without checking
+ * its size, prefix or suffix. Both read every byte of the info, as the
+ * handlers do.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "niSysex.h"
+
+using namespace std;
+
+const unsigned char CMD_SET_TEMPO = 0x19;
+const unsigned char CMD_SELECT_PLUGIN = 0x70;
+const unsigned char CMD_PARAM_HIGH_RES = 0x7F;
+const int NUM_PASSES = 200;
+
+using Message = vector<unsigned char>;
+
+static Message makeSysex(unsigned char command, unsigned char value,
+	unsigned char index, const vector<unsigned char>& info
+) {
+	Message message(begin(MIDI_SYSEX_BEGIN), end(MIDI_SYSEX_BEGIN));
+	message.push_back(command);
+	message.push_back(value);
+	message.push_back(index);
+	message.insert(message.end(), info.begin(), info.end());
+	message.push_back(MIDI_SYSEX_END);
+	return message;
+}
+
+// The parsing NiMidiSurface used to do.
+static unsigned int parseOld(const Message& message) {
+	const unsigned char* data = message.data() + sizeof(MIDI_SYSEX_BEGIN);
+	const unsigned char command = *data;
+	++data;
+	const unsigned char value = *data;
+	++data;
+	const unsigned char index = *data;
+	++data;
+	const int infoSize = message.size() - sizeof(MIDI_SYSEX_BEGIN) - 4;
+	unsigned int sum = command + value + index;
+	for (int i = 0; i < infoSize; ++i) {
+		sum += data[i];
+	}
+	return sum;
+}
+
+static unsigned int parseNew(const Message& message) {
+	SysexFrame frame;
+	if (!parseSysex(message, frame)) {
+		return 0;
+	}
+	unsigned int sum = frame.command + frame.value + frame.index;
+	for (unsigned char byte : frame.info) {
+		sum += byte;
+	}
+	return sum;
+}
+
+template<typename Parse>
+void run(const char* name, const vector<Message>& messages, size_t bytes,
+	Parse parse
+) {
+	unsigned int sum = 0;
+	const auto start = chrono::steady_clock::now();
+	for (int pass = 0; pass < NUM_PASSES; ++pass) {
+		for (const Message& message : messages) {
+			sum += parse(message);
+		}
+	}
+	const auto elapsed = chrono::steady_clock::now() - start;
+	const double ns = chrono::duration<double, nano>(elapsed).count();
+	// The sum stops the compiler from dropping the work. It must be the same for
+	// both.
+	printf("%-10s %6.2f ns per message, %7.1f MB/s (sum %u)\n", name,
+		ns / (NUM_PASSES * messages.size()),
+		bytes * NUM_PASSES / (ns / 1e9) / 1e6, sum);
+}
+
+int main() {
+	vector<Message> messages;
+	size_t bytes = 0;
+	unsigned int seed = 1;
+	auto random = [&seed](unsigned int limit) {
+		seed = seed * 1664525 + 1013904223;
+		return (seed >> 8) % limit;
+	};
+	for (int m = 0; m < 100000; ++m) {
+		const unsigned int kind = random(100);
+		if (kind == 0) {
+			// 120 bpm.
+			messages.push_back(makeSysex(CMD_SET_TEMPO, 0, 0,
+				{0x00, 0x61, 0x6B, 0x17, 0x00}));
+		} else if (kind == 1) {
+			vector<unsigned char> name(random(60) + 1, 'a');
+			messages.push_back(makeSysex(CMD_SELECT_PLUGIN, 0, random(8), name));
+		} else {
+			messages.push_back(makeSysex(CMD_PARAM_HIGH_RES, random(3), random(8),
+				{(unsigned char)random(128), (unsigned char)random(128)}));
+		}
+		bytes += messages.back().size();
+	}
+	run("old", messages, bytes, parseOld);
+	run("parseSysex", messages, bytes, parseNew);
+	return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * ReaKontrol
+ * Benchmark of the volume to CC conversions
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ *
+ * Build and run from the repository root with:
+ * clang++ -std=c++20 -O2 -Isrc -Iinclude/WDL check/volToCcBench.cpp src/volCc.cpp -o volToCcBench
+ * ./volToCcBench
+ *
+ * This compares the old conversion, which calls the exact formula for every
+ * volume, with volToCc one slot at a time and volsToCcs a bank at a time. As in
+ * volToCcCheck, REAPER's DB2SLIDER is replaced by a stand-in curve, so the time
+ * for the old conversion is only an estimate of the cost inside REAPER.
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <WDL/db2val.h>
+#include "volCc.h"
+
+using namespace std;
+
+// The same stand-in as volToCcCheck.
+double DB2SLIDER(double db) {
+	db = clamp(db, -150.0, 12.0);
+	return 1000.0 * pow((db + 150.0) / 162.0, 4.33);
+}
+
+// The same as volToCcExact in niMidi.cpp.
+unsigned char volToCcExact(double volume) {
+	double val = DB2SLIDER(VAL2DB(volume)) * 127.0 / 1000.0;
+	val = clamp(val, 0.0, 127.0);
+	return (unsigned char)(val + 0.5);
+}
+
+constexpr size_t NUM_BANKS = 1 << 16;
+constexpr int NUM_PASSES = 20;
+using Bank = array<double, 8>;
+
+template<typename Convert>
+void run(const char* name, const vector<Bank>& banks, Convert convert) {
+	unsigned int sum = 0;
+	const auto start = chrono::steady_clock::now();
+	for (int pass = 0; pass < NUM_PASSES; ++pass) {
+		for (const Bank& bank : banks) {
+			sum += convert(bank);
+		}
+	}
+	const auto elapsed = chrono::steady_clock::now() - start;
+	const double ns = chrono::duration<double, nano>(elapsed).count();
+	// The sum stops the compiler from dropping the work. It must be the same for
+	// every conversion.
+	printf("%-10s %8.2f ns per volume (sum %u)\n", name,
+		ns / (NUM_PASSES * NUM_BANKS * 8), sum);
+}
+
+int main() {
+	const VolCcThresholds thresholds = makeVolCcThresholds(volToCcExact);
+	// Volumes spread between -inf and +12 dB, much like a real project.
+	vector<Bank> banks(NUM_BANKS);
+	unsigned int seed = 1;
+	for (Bank& bank : banks) {
+		for (double& volume : bank) {
+			seed = seed * 1664525 + 1013904223;
+			volume = (seed >> 8) / double(1 << 24) * 4.0;
+		}
+	}
+	run("exact", banks, [](const Bank& bank) {
+		unsigned int sum = 0;
+		for (double volume : bank) {
+			sum += volToCcExact(volume);
+		}
+		return sum;
+	});
+	run("volToCc", banks, [&](const Bank& bank) {
+		unsigned int sum = 0;
+		for (double volume : bank) {
+			sum += volToCc(thresholds, volume);
+		}
+		return sum;
+	});
+	run("volsToCcs", banks, [&](const Bank& bank) {
+		array<unsigned char, 8> ccs;
+		volsToCcs(thresholds, bank, ccs);
+		unsigned int sum = 0;
+		for (unsigned char cc : ccs) {
+			sum += cc;
+		}
+		return sum;
+	});
+	return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * ReaKontrol
+ * Check that the fast volume and pan to CC conversions match the originals
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ *
+ * Build and run from the repository root with:
+ * clang++ -std=c++20 -Isrc -Iinclude/WDL check/volToCcCheck.cpp src/volCc.cpp -o volToCcCheck
+ * ./volToCcCheck
+ *
+ * Note that REAPER's DB2SLIDER curve can't be used outside REAPER, so this
+ * only shows that the thresholds match the exact formula for a stand-in curve
+ * of the same range and shape. It doesn't prove that they match REAPER's own
+ * curve. Inside REAPER, the thresholds are built from the real curve by the
+ * same code, which only relies on the curve never decreasing.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <vector>
+#include <WDL/db2val.h>
+#include "volCc.h"
+
+using namespace std;
+
+// REAPER's DB2SLIDER isn't available outside REAPER. The thresholds only rely
+// on the curve never decreasing, so this stand-in has the same range and a
+// similar shape: -150 dB is 0, 0 dB is about 716 and +12 dB is 1000.
+double DB2SLIDER(double db) {
+	db = clamp(db, -150.0, 12.0);
+	return 1000.0 * pow((db + 150.0) / 162.0, 4.33);
+}
+
+// The same as volToCcExact in niMidi.cpp.
+unsigned char volToCcExact(double volume) {
+	double val = DB2SLIDER(VAL2DB(volume)) * 127.0 / 1000.0;
+	val = clamp(val, 0.0, 127.0);
+	return (unsigned char)(val + 0.5);
+}
+
+int numFailures = 0;
+// Every volume we check, so we can check volsToCcs against the same values.
+vector<double> checkedVolumes;
+
+void check(const VolCcThresholds& thresholds, double volume) {
+	checkedVolumes.push_back(volume);
+	const unsigned char fast = volToCc(thresholds, volume);
+	const unsigned char exact = volToCcExact(volume);
+	if (fast != exact) {
+		printf("%.17g: volToCc %d, exact %d\n", volume, fast, exact);
+		++numFailures;
+	}
+}
+
+// volsToCcs must give the same result as volToCc for every slot.
+void checkBatches(const VolCcThresholds& thresholds) {
+	array<double, 8> volumes {};
+	array<unsigned char, 8> ccs;
+	for (size_t start = 0; start < checkedVolumes.size(); start += volumes.size()) {
+		for (size_t i = 0; i < volumes.size(); ++i) {
+			// Wrap at the end so the last batch is full.
+			volumes[i] = checkedVolumes[(start + i) % checkedVolumes.size()];
+		}
+		volsToCcs(thresholds, volumes, ccs);
+		for (size_t i = 0; i < volumes.size(); ++i) {
+			const unsigned char single = volToCc(thresholds, volumes[i]);
+			if (ccs[i] != single) {
+				printf("%.17g: volsToCcs %d, volToCc %d\n", volumes[i], ccs[i],
+					single);
+				++numFailures;
+			}
+		}
+	}
+}
+
+void checkPans() {
+	array<double, 8> pans {};
+	array<unsigned char, 8> ccs;
+	size_t slot = 0;
+	// Step by an amount that doesn't divide the range evenly, so we don't only
+	// check values on a grid.
+	for (double pan = -1.5; pan <= 1.5; pan += 0.0001234) {
+		pans[slot++] = pan;
+		if (slot < pans.size()) {
+			continue;
+		}
+		slot = 0;
+		pansToCcs(pans, ccs);
+		for (size_t i = 0; i < pans.size(); ++i) {
+			const unsigned char single = panToCc(pans[i]);
+			if (ccs[i] != single) {
+				printf("%.17g: pansToCcs %d, panToCc %d\n", pans[i], ccs[i], single);
+				++numFailures;
+			}
+		}
+	}
+	if (panToCc(-1.0) != 0 || panToCc(0.0) != 64 || panToCc(1.0) != 127) {
+		printf("panToCc gives the wrong value at -1, 0 or 1\n");
+		++numFailures;
+	}
+}
+
+int main() {
+	const VolCcThresholds thresholds = makeVolCcThresholds(volToCcExact);
+	constexpr double inf = numeric_limits<double>::infinity();
+	// Each CC boundary and the doubles either side of it.
+	for (int cc = 1; cc < 128; ++cc) {
+		const double threshold = thresholds[cc];
+		check(thresholds, nextafter(threshold, -inf));
+		check(thresholds, threshold);
+		check(thresholds, nextafter(threshold, inf));
+	}
+	// Volumes across the whole range, including some REAPER never gives us.
+	for (double volume = 1e-9; volume < 16.0; volume *= 1.00001) {
+		check(thresholds, volume);
+	}
+	for (double volume : {-1.0, -0.0, 0.0, 16.0, 1000.0, inf}) {
+		check(thresholds, volume);
+	}
+	checkBatches(thresholds);
+	checkPans();
+	if (numFailures > 0) {
+		printf("%d failures\n", numFailures);
+		return 1;
+	}
+	printf("volToCc, volsToCcs and pansToCcs match\n");
+	return 0;
+}
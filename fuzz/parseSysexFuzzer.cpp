@@ -0,0 +1,28 @@
+/*
+ * ReaKontrol
+ * libFuzzer target for parsing sysex from the device
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ *
+ * Build and run from the repository root with:
+ * clang++ -std=c++20 -g -fsanitize=fuzzer,address,undefined -Isrc fuzz/parseSysexFuzzer.cpp src/niSysex.cpp -o parseSysexFuzzer
+ * ./parseSysexFuzzer
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include "niSysex.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	SysexFrame frame;
+	if (!parseSysex({data, size}, frame)) {
+		return 0;
+	}
+	// info must lie entirely within the message, just before the suffix.
+	if (frame.info.size() != size - SYSEX_OVERHEAD ||
+			frame.info.data() + frame.info.size() != data + size - 1) {
+		abort();
+	}
+	return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * ReaKontrol
+ * Command dispatch tables header
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+// A range of consecutive commands handled by the same handler. The handler is
+// passed the position of the command within the range; e.g. the slot number for
+// CMD_KNOB_VOLUME0 to CMD_KNOB_VOLUME7.
+template<typename Handler>
+struct CommandRange {
+	unsigned char command;
+	unsigned char count;
+	Handler handler;
+};
+
+template<typename Handler>
+struct DispatchEntry {
+	Handler handler = nullptr;
+	unsigned char slot = 0;
+};
+
+template<typename Handler>
+using DispatchTable = std::array<DispatchEntry<Handler>, 128>;
+
+// Build a table indexed by command byte from a list of command ranges, so that
+// dispatching a command is a single lookup.
+template<typename Handler, size_t numRanges>
+constexpr DispatchTable<Handler> makeDispatchTable(
+	const CommandRange<Handler> (&ranges)[numRanges]
+) {
+	DispatchTable<Handler> table {};
+	for (const CommandRange<Handler>& range : ranges) {
+		for (unsigned char slot = 0; slot < range.count; ++slot) {
+			table[range.command + slot] = {range.handler, slot};
+		}
+	}
+	return table;
+}
@@ -10,23 +10,20 @@
 #include <WDL/win32_utf8.h>
 #endif
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
-#include <regex>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include "fxMap.h"
 #include "reaKontrol.h"
 
-// Strip leading and trailing space, as well as comments.
-static const std::regex RE_STRIP(R"(^\s+|\s*#.*$|\s+$)");
-// The map name, ending with a colon.
-static const std::regex RE_MAP_NAME("(.*):");
-// A parameter number, optionally followed by space and a scaling factor (/n or
-// *n), optionally followed by space and a name.
-static const std::regex RE_PARAM(R"((\d+)(?:\s+([/*])(\d+))?(?:\s+(.+))?)");
-// A section name in square brackets.
-static const std::regex RE_SECTION(R"(\[(.+)\])");
+// Map files used to be parsed with regular expressions, which were slow for
+// large maps. The parsing functions below give exactly the same results as
+// those expressions did, including for unusual lines, so existing maps keep
+// working the same way. The expressions are quoted in each function.
 
 // The generateMapFileForSelectedFx action can't access the FxMap instance,
 // so we cache the last selected FX here.
@@ -59,77 +56,277 @@ static std::filesystem::path getFxMapFileName(MediaTrack* track, int fx) {
 	return path;
 }
 
-static std::string getLine(std::ifstream& input) {
-	std::string line;
-	while (std::getline(input, line)) {
-		line = std::regex_replace(line, RE_STRIP, "");
-		if (!line.empty()) {
-			// Not a blank line, only space or a comment.
-			return line;
+// The characters matched by \s.
+static bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+		c == '\r';
+}
+
+static bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+// The characters not matched by ".".
+static bool isLineTerminator(char c) {
+	return c == '\n' || c == '\r';
+}
+
+// Return the length of the text starting at pos which "." matches.
+static size_t getDotLength(std::string_view line, size_t pos) {
+	size_t end = pos;
+	while (end < line.size() && !isLineTerminator(line[end])) {
+		++end;
+	}
+	return end - pos;
+}
+
+// Strip leading and trailing space, as well as comments. This is equivalent to
+// replacing ^\s+|\s*#.*$|\s+$ with nothing.
+static std::string_view stripLine(std::string_view line) {
+	size_t start = 0;
+	while (start < line.size() && isSpace(line[start])) {
+		++start;
+	}
+	// ".*$" can't pass a line terminator, so a comment starts at the first # after
+	// the last line terminator.
+	size_t end = line.size();
+	size_t searchFrom = start;
+	for (size_t i = line.size(); i > start; --i) {
+		if (isLineTerminator(line[i - 1])) {
+			searchFrom = i;
+			break;
+		}
+	}
+	const size_t hash = line.find('#', searchFrom);
+	if (hash != std::string_view::npos) {
+		end = hash;
+	}
+	while (end > start && isSpace(line[end - 1])) {
+		--end;
+	}
+	return line.substr(start, end - start);
+}
+
+// Get the next line from contents which isn't blank, only space or a comment,
+// advancing contents past it. Returns an empty line when there are no more
+// lines.
+static std::string_view getLine(std::string_view& contents) {
+	while (!contents.empty()) {
+		const size_t newline = contents.find('\n');
+		const std::string_view line = contents.substr(0, newline);
+		contents.remove_prefix(
+			newline == std::string_view::npos ? contents.size() : newline + 1);
+		const std::string_view stripped = stripLine(line);
+		if (!stripped.empty()) {
+			return stripped;
+		}
+	}
+	return {};
+}
+
+// The map name, ending with a colon. This is equivalent to searching for
+// (.*):
+static bool parseMapName(std::string_view line, std::string_view& name) {
+	// The match starts at the first stretch of text matched by "." which contains
+	// a colon and ends at the last colon in that stretch.
+	for (size_t pos = 0; pos < line.size(); ) {
+		const std::string_view text = line.substr(pos, getDotLength(line, pos));
+		const size_t colon = text.rfind(':');
+		if (colon != std::string_view::npos) {
+			name = text.substr(0, colon);
+			return true;
+		}
+		pos += text.size() + 1;
+	}
+	return false;
+}
+
+struct ParamLine {
+	std::string_view reaperParam;
+	std::string_view scaleType;
+	std::string_view factor;
+	std::string_view name;
+};
+
+// A parameter number, optionally followed by space and a scaling factor (/n or
+// *n), optionally followed by space and a name. This is equivalent to
+// searching for (\d+)(?:\s+([/*])(\d+))?(?:\s+(.+))?
+static bool parseParam(std::string_view line, ParamLine& param) {
+	param = {};
+	auto getDigitsLength = [&line](size_t pos) {
+		size_t end = pos;
+		while (end < line.size() && isDigit(line[end])) {
+			++end;
+		}
+		return end - pos;
+	};
+	auto getSpaceLength = [&line](size_t pos) {
+		size_t end = pos;
+		while (end < line.size() && isSpace(line[end])) {
+			++end;
+		}
+		return end - pos;
+	};
+	size_t pos = 0;
+	while (pos < line.size() && !isDigit(line[pos])) {
+		++pos;
+	}
+	if (pos == line.size()) {
+		return false;
+	}
+	const size_t paramLength = getDigitsLength(pos);
+	param.reaperParam = line.substr(pos, paramLength);
+	pos += paramLength;
+	size_t space = getSpaceLength(pos);
+	if (space > 0 && pos + space < line.size() &&
+			(line[pos + space] == '/' || line[pos + space] == '*')) {
+		const size_t factorLength = getDigitsLength(pos + space + 1);
+		if (factorLength > 0) {
+			param.scaleType = line.substr(pos + space, 1);
+			param.factor = line.substr(pos + space + 1, factorLength);
+			pos += space + 1 + factorLength;
+			space = getSpaceLength(pos);
+		}
+	}
+	if (space == 0) {
+		return true;
+	}
+	// \s+ gives back space if (.+) can't otherwise match anything.
+	while (space > 0 && getDotLength(line, pos + space) == 0) {
+		--space;
+	}
+	if (space > 0) {
+		param.name = line.substr(pos + space, getDotLength(line, pos + space));
+	}
+	return true;
+}
+
+// A section name in square brackets. This is equivalent to searching for
+// \[(.+)\]
+static bool parseSection(std::string_view line, std::string_view& section) {
+	for (size_t open = line.find('['); open != std::string_view::npos;
+			open = line.find('[', open + 1)) {
+		// The name can't be empty and ends at the last ] in the text matched by ".".
+		const std::string_view text =
+			line.substr(open + 1, getDotLength(line, open + 1));
+		const size_t close = text.rfind(']');
+		if (close != std::string_view::npos && close > 0) {
+			section = text.substr(0, close);
+			return true;
 		}
 	}
-	return "";
+	return false;
+}
+
+static bool readFile(const std::filesystem::path& path, std::string& contents) {
+	std::ifstream input(path);
+	if (!input) {
+		return false;
+	}
+	contents.assign(std::istreambuf_iterator<char>(input),
+		std::istreambuf_iterator<char>());
+	return true;
 }
 
-FxMap::FxMap(MediaTrack* track, int fx) : _track(track), _fx(fx) {
+FxMap::FxMap(MediaTrack* track, int fx)
+: _track(track), _fx(fx), _strings(1, '\0') {
 	lastTrack = track;
 	lastFx = fx;
 	const std::filesystem::path path = getFxMapFileName(track, fx);
 	if (path.empty()) {
 		return;
 	}
-	std::ifstream input(path);
-	if (!input) {
+	std::string contents;
+	if (!readFile(path, contents)) {
 		log("no FX map " << path);
 		return;
 	}
 	log("loading FX map " << path);
-	for (std::string line = getLine(input); !line.empty(); line = getLine(input)) {
-		std::smatch m;
-		std::regex_search(line, m, RE_MAP_NAME);
-		if (!m.empty()) {
+	std::string_view remaining = contents;
+	for (std::string_view line = getLine(remaining); !line.empty();
+			line = getLine(remaining)) {
+		std::string_view mapName;
+		if (parseMapName(line, mapName)) {
 			if (!this->_mapName.empty()) {
 				log("map name specified more than once, ignoring: " << line);
 				continue;
 			}
-			this->_mapName = m.str(1);
+			this->_mapName = mapName;
 			log("map name: " << this->_mapName);
 			continue;
 		}
-		std::regex_search(line, m, RE_PARAM);
-		if (!m.empty()) {
-			const int rp = std::atoi(m.str(1).c_str());
-			const int mp = this->_reaperParams.size();
-			this->_reaperParams.push_back(rp);
-			this->_mapParams.insert({rp, mp});
-			const std::string scaleType = m.str(2);
-			if (!scaleType.empty()) {
-				const int factor = std::atoi(m.str(3).c_str());
-				this->_paramMultipliers.insert({mp,
-					scaleType == "/" ? (1.0 / factor) : factor});
-			}
-			const std::string paramName = m.str(4);
-			if (!paramName.empty()) {
-				this->_paramNames.insert({mp, paramName});
+		ParamLine param;
+		if (parseParam(line, param)) {
+			const int rp = std::atoi(std::string(param.reaperParam).c_str());
+			double multiplier = 1.0;
+			if (!param.scaleType.empty()) {
+				const int factor = std::atoi(std::string(param.factor).c_str());
+				multiplier = param.scaleType == "/" ? (1.0 / factor) : factor;
 			}
+			this->_addSlot(rp, multiplier, param.name);
 			continue;
 		}
 		if (line == "---") {
 			// A page break has been requested. Any remaining slots on this page
 			// should be empty.
-			while (this->_reaperParams.size() % BANK_NUM_SLOTS != 0) {
-				this->_reaperParams.push_back(-1);
+			while (this->_slots.size() % BANK_NUM_SLOTS != 0) {
+				this->_addSlot(-1);
 			}
 			continue;
 		}
-		std::regex_search(line, m, RE_SECTION);
-		if (!m.empty()) {
-			this->_sections.insert({this->_reaperParams.size(), m.str(1)});
+		std::string_view section;
+		if (parseSection(line, section)) {
+			// If there are several sections before a parameter, the first wins.
+			if (this->_pendingSectionOffset == NO_STRING) {
+				this->_pendingSectionOffset = this->_addString(section);
+			}
 			continue;
 		}
 		log("invalid FX map line: " << line);
 	}
-	log("loaded " << this->_mapParams.size() << " params from FX map");
+	if (this->_slots.empty()) {
+		return;
+	}
+	// Index every parameter in the map, even if the FX doesn't have it now, as
+	// an FX can add parameters after the map is loaded. A mistake in a map file
+	// could give a huge parameter number, so those beyond MAX_INDEXED_PARAM are
+	// found by searching the slots instead.
+	int maxReaperParam = -1;
+	for (const Slot& slot : this->_slots) {
+		maxReaperParam = std::max(maxReaperParam, slot.reaperParam);
+	}
+	this->_mapParams.assign(std::min(maxReaperParam, MAX_INDEXED_PARAM) + 1, -1);
+	int numMapped = 0;
+	for (int mp = 0; mp < (int)this->_slots.size(); ++mp) {
+		const int rp = this->_slots[mp].reaperParam;
+		// If a parameter is mapped more than once, the first wins.
+		if (rp < 0) {
+			continue;
+		}
+		if (rp > MAX_INDEXED_PARAM) {
+			++numMapped;
+		} else if (this->_mapParams[rp] == -1) {
+			this->_mapParams[rp] = mp;
+			++numMapped;
+		}
+	}
+	log("loaded " << numMapped << " params from FX map");
+}
+
+void FxMap::_addSlot(int reaperParam, double multiplier,
+	std::string_view name
+) {
+	this->_slots.push_back({reaperParam, multiplier,
+		name.empty() ? NO_STRING : this->_addString(name),
+		this->_pendingSectionOffset});
+	this->_pendingSectionOffset = NO_STRING;
+}
+
+uint32_t FxMap::_addString(std::string_view str) {
+	const uint32_t offset = this->_strings.size();
+	this->_strings += str;
+	this->_strings += '\0';
+	return offset;
 }
 
 std::string FxMap::getMapName() const {
@@ -142,62 +339,76 @@ std::string FxMap::getMapName() const {
 }
 
 int FxMap::getParamCount() const {
-	if (this->_reaperParams.empty()) {
+	if (this->_slots.empty()) {
 		return TrackFX_GetNumParams(this->_track, this->_fx);
 	}
-	return this->_reaperParams.size();
+	return this->_slots.size();
 }
 
 int FxMap::getReaperParam(int mapParam) const {
-	if (this->_reaperParams.empty()) {
+	if (this->_slots.empty()) {
 		return mapParam;
 	}
-	return this->_reaperParams[mapParam];
+	return this->_slots[mapParam].reaperParam;
 }
 
 int FxMap::getMapParam(int reaperParam) const {
-	if (this->_reaperParams.empty()) {
+	if (this->_slots.empty()) {
 		return reaperParam;
 	}
-	auto it = this->_mapParams.find(reaperParam);
-	if (it == this->_mapParams.end()) {
+	if (reaperParam > MAX_INDEXED_PARAM) {
+		for (int mp = 0; mp < (int)this->_slots.size(); ++mp) {
+			if (this->_slots[mp].reaperParam == reaperParam) {
+				return mp;
+			}
+		}
+		return -1;
+	}
+	if (reaperParam < 0 || reaperParam >= (int)this->_mapParams.size()) {
 		return -1;
 	}
-	return it->second;
+	return this->_mapParams[reaperParam];
 }
 
 std::string FxMap::getParamName(int mapParam) const {
-	auto it = this->_paramNames.find(mapParam);
-	if (it == this->_paramNames.end()) {
-		char name[100];
-		const int rp = this->getReaperParam(mapParam);
-		TrackFX_GetParamName(this->_track, this->_fx, rp, name, sizeof(name));
-		return name;
+	if (this->hasParamName(mapParam)) {
+		return this->_getString(this->_slots[mapParam].nameOffset);
 	}
-	return it->second;
+	char name[100];
+	const int rp = this->getReaperParam(mapParam);
+	TrackFX_GetParamName(this->_track, this->_fx, rp, name, sizeof(name));
+	return name;
+}
+
+bool FxMap::hasParamName(int mapParam) const {
+	return mapParam >= 0 && mapParam < (int)this->_slots.size() &&
+		this->_slots[mapParam].nameOffset != NO_STRING;
 }
 
 double FxMap::getParamMultiplier(int mapParam) const {
-	auto it = this->_paramMultipliers.find(mapParam);
-	if (it == this->_paramMultipliers.end()) {
+	if (mapParam < 0 || mapParam >= (int)this->_slots.size()) {
 		return 1.0;
 	}
-	return it->second;
+	return this->_slots[mapParam].multiplier;
 }
 
 std::string FxMap::getSection(int mapParam) const {
-	auto it = this->_sections.find(mapParam);
-	if (it == this->_sections.end()) {
+	if (mapParam == (int)this->_slots.size()) {
+		// A section after the last parameter applies to the slot after it. If the
+		// map has no parameters, that is the first of the FX's own parameters.
+		return this->_getString(this->_pendingSectionOffset);
+	}
+	if (mapParam < 0 || mapParam >= (int)this->_slots.size()) {
 		return "";
 	}
-	return it->second;
+	return this->_getString(this->_slots[mapParam].sectionOffset);
 }
 
 std::string FxMap::getSectionsForPage(int mapParam) const {
 	std::ostringstream s;
 	int bankEnd = mapParam + BANK_NUM_SLOTS;
-	if (bankEnd > this->_reaperParams.size()) {
-		bankEnd = this->_reaperParams.size();
+	if (bankEnd > (int)this->_slots.size()) {
+		bankEnd = this->_slots.size();
 	}
 	for (; mapParam < bankEnd; ++mapParam) {
 		std::string section = this->getSection(mapParam);
@@ -221,19 +432,16 @@ std::string FxMap::getMapNameFor(MediaTrack* track, int fx) {
 	if (path.empty()) {
 		return getOrigName();
 	}
-	std::ifstream input(path);
-	if (!input) {
+	std::string contents;
+	if (!readFile(path, contents)) {
 		return getOrigName();
 	}
-	for (std::string line = getLine(input); !line.empty(); line = getLine(input)) {
-		std::smatch m;
-		std::regex_search(line, m, RE_MAP_NAME);
-		if (m.empty()) {
-			// The map name must be the first non-comment, non-blank line. If we hit
-			// anything else, there's no map name, so don't process any further.
-			break;
-		}
-		return m.str(1);
+	std::string_view remaining = contents;
+	// The map name must be the first non-comment, non-blank line. If it's
+	// anything else, there's no map name.
+	std::string_view name;
+	if (parseMapName(getLine(remaining), name)) {
+		return std::string(name);
 	}
 	return getOrigName();
 }
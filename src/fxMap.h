@@ -8,8 +8,9 @@
 
 #pragma once
 
-#include <map>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class MediaTrack;
@@ -23,6 +24,9 @@ class FxMap {
 	int getReaperParam(int mapParam) const;
 	int getMapParam(int reaperParam) const;
 	std::string getParamName(int mapParam) const;
+	// Whether the map file gives a name for this parameter. If not,
+	// getParamName gets the name from REAPER.
+	bool hasParamName(int mapParam) const;
 	double getParamMultiplier(int mapParam) const;
 	std::string getSection(int mapParam) const;
 	std::string getSectionsForPage(int mapParam) const;
@@ -31,12 +35,37 @@ class FxMap {
 	static void generateMapFileForSelectedFx();
 
 	private:
+	// The information for a slot in the map.
+	struct Slot {
+		// -1 if this slot is empty; e.g. padding before a page break.
+		int reaperParam;
+		double multiplier;
+		// Offsets of null terminated strings in _strings, or NO_STRING.
+		uint32_t nameOffset;
+		uint32_t sectionOffset;
+	};
+	static constexpr uint32_t NO_STRING = 0;
+	// The highest REAPER parameter which _mapParams can hold.
+	static constexpr int MAX_INDEXED_PARAM = 65535;
+
+	void _addSlot(int reaperParam, double multiplier = 1.0,
+		std::string_view name = {});
+	uint32_t _addString(std::string_view str);
+	const char* _getString(uint32_t offset) const {
+		return this->_strings.c_str() + offset;
+	}
+
 	std::string _mapName;
 	MediaTrack* _track = nullptr;
 	int _fx = -1;
-	std::vector<int> _reaperParams;
-	std::map<int, std::string> _paramNames;
-	std::map<int, double> _paramMultipliers;
-	std::map<int, int> _mapParams;
-	std::map<int, std::string> _sections;
+	// Indexed by map parameter.
+	std::vector<Slot> _slots;
+	// Maps REAPER parameters to map parameters, or -1 if a REAPER parameter isn't
+	// mapped. Indexed by REAPER parameter, up to the highest in the map.
+	std::vector<int> _mapParams;
+	// All names and sections, each followed by a null character. This starts
+	// with an empty string, so NO_STRING is never a real string.
+	std::string _strings;
+	// A section which applies to the next slot we add.
+	uint32_t _pendingSectionOffset = NO_STRING;
 };
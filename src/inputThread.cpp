@@ -0,0 +1,110 @@
+/*
+ * ReaKontrol
+ * MIDI input thread code
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <chrono>
+#include "inputThread.h"
+#include "reaKontrol.h"
+
+// The ring buffer size. The device only sends a few bytes per control change,
+// so this only fills if the main thread is blocked for a long time.
+constexpr size_t RING_SIZE = 16 * 1024;
+// How often the thread checks for input.
+constexpr auto POLL_INTERVAL = std::chrono::milliseconds(1);
+
+uint64_t getInputTime() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t getInputArrivalTime(const MIDI_event_t* event, uint64_t lastSwapTime,
+	uint64_t swapTime
+) {
+	// The frame offset is in units of 1/1024000 of a second since the buffer
+	// was last swapped.
+	const uint64_t offset = (uint64_t)std::max(event->frame_offset, 0) * 125 / 128;
+	return std::min(lastSwapTime + offset, swapTime);
+}
+
+InputThread::InputThread(midi_Input* input,
+	bool (*isUrgent)(const MIDI_event_t*), void (*wake)()
+) : _input(input), _isUrgent(isUrgent), _wakeFunc(wake), _ring(RING_SIZE) {
+	this->_thread = std::thread(&InputThread::_run, this);
+}
+
+InputThread::~InputThread() {
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		this->_stop = true;
+	}
+	this->_cond.notify_one();
+	this->_thread.join();
+}
+
+InputThread::Stats InputThread::getStats() const {
+	return {this->_receivedMessages, this->_wakes, this->_overflows,
+		this->_ring.getMaxUsed()};
+}
+
+void InputThread::_wake() {
+	if (!this->_wakePending.exchange(true)) {
+		++this->_wakes;
+		this->_wakeFunc();
+	}
+}
+
+void InputThread::_run() {
+	uint64_t lastSwapTime = getInputTime();
+	while (!this->_stop) {
+		const uint64_t swapTime = getInputTime();
+		this->_input->SwapBufs(timeGetTime());
+		MIDI_eventlist* list = this->_input->GetReadBuf();
+		MIDI_event_t* event;
+		int i = 0;
+		bool urgent = false;
+		while ((event = list->EnumItems(&i))) {
+			if (!this->_ring.canFit(event)) {
+				// We never get messages this large from a device we support.
+				continue;
+			}
+			const uint64_t arrival = getInputArrivalTime(event, lastSwapTime,
+				swapTime);
+			for (; ;) {
+				uint64_t handles;
+				{
+					std::lock_guard<std::mutex> lock(this->_mutex);
+					handles = this->_handles;
+				}
+				if (this->_ring.push(event, arrival)) {
+					break;
+				}
+				// The main thread is behind. Make sure it knows there's work to do and
+				// wait until it has made room.
+				++this->_overflows;
+				this->_wake();
+				std::unique_lock<std::mutex> lock(this->_mutex);
+				this->_cond.wait(lock, [this, handles] {
+					return this->_stop || this->_handles != handles;
+				});
+				if (this->_stop) {
+					return;
+				}
+			}
+			++this->_receivedMessages;
+			urgent = urgent || this->_isUrgent(event);
+		}
+		lastSwapTime = swapTime;
+		if (urgent) {
+			this->_wake();
+		}
+		std::unique_lock<std::mutex> lock(this->_mutex);
+		this->_cond.wait_for(lock, POLL_INTERVAL, [this] {
+			return this->_stop.load();
+		});
+	}
+}
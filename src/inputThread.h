@@ -0,0 +1,99 @@
+/*
+ * ReaKontrol
+ * MIDI input thread header
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "midiRing.h"
+
+// The current time in microseconds, used to time MIDI input.
+uint64_t getInputTime();
+// Estimate when a message read from a midi_Input arrived. lastSwapTime and
+// swapTime are the input times of the previous and current SwapBufs calls.
+uint64_t getInputArrivalTime(const MIDI_event_t* event, uint64_t lastSwapTime,
+	uint64_t swapTime);
+
+// Reads MIDI messages from a midi_Input on a dedicated thread, which polls much
+// more often than REAPER calls Run(). midi_Input can't notify us of input, so
+// the thread has to poll it. It waits between polls on a condition variable,
+// so that it stops promptly and resumes as soon as the main thread makes room
+// in a full buffer. Messages are passed to the main thread
+// through a lock-free ring buffer. REAPER's API can only be used on the main
+// thread, so when an urgent message such as a transport button arrives, the
+// thread asks the main thread to handle the queue straight away instead of
+// waiting for the next Run().
+class InputThread {
+	public:
+	// isUrgent is called on the input thread for each message, so it must not
+	// touch the surface. When it returns true, wake is called on the input
+	// thread. wake won't be called again until handle has been called.
+	InputThread(midi_Input* input, bool (*isUrgent)(const MIDI_event_t*),
+		void (*wake)());
+	~InputThread();
+
+	// Call func(event, arrivalTime) on the calling thread for each message
+	// received since the last call, in the order they arrived.
+	template<typename Func>
+	void handle(Func func) {
+		// Clear this first, so that an urgent message which arrives while we're
+		// handling wakes the main thread again.
+		this->_wakePending = false;
+		uint64_t time;
+		bool handled = false;
+		while (MIDI_event_t* event = this->_ring.front(&time)) {
+			func(event, time);
+			this->_ring.pop();
+			handled = true;
+		}
+		if (handled) {
+			// The thread might be waiting for room in the buffer.
+			{
+				std::lock_guard<std::mutex> lock(this->_mutex);
+				++this->_handles;
+			}
+			this->_cond.notify_one();
+		}
+	}
+
+	struct Stats {
+		uint64_t receivedMessages;
+		// The number of times the main thread was woken for an urgent message.
+		uint64_t wakes;
+		// The number of times the buffer was full, delaying reading.
+		uint64_t overflows;
+		// The most bytes that have been waiting in the buffer at once.
+		size_t maxUsed;
+	};
+	Stats getStats() const;
+
+	private:
+	void _run();
+	void _wake();
+
+	midi_Input* _input;
+	bool (*_isUrgent)(const MIDI_event_t*);
+	void (*_wakeFunc)();
+	MidiRing _ring;
+	// Protects _handles and waiting on _cond.
+	std::mutex _mutex;
+	// Notified when handle has made room in the buffer or the thread should
+	// stop.
+	std::condition_variable _cond;
+	// The number of times handle has made room in the buffer.
+	uint64_t _handles = 0;
+	std::atomic<bool> _stop = false;
+	std::atomic<bool> _wakePending = false;
+	std::atomic<uint64_t> _receivedMessages = 0;
+	std::atomic<uint64_t> _wakes = 0;
+	std::atomic<uint64_t> _overflows = 0;
+	std::thread _thread;
+};
@@ -0,0 +1,52 @@
+/*
+ * ReaKontrol
+ * Latency histogram code
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <bit>
+#include "latencyHistogram.h"
+
+// Values below 4 get a bucket each. Above that, the bucket is determined by
+// the highest set bit and the 2 bits below it.
+static size_t getBucket(uint64_t value) {
+	if (value < 4) {
+		return value;
+	}
+	const int exponent = std::bit_width(value) - 1;
+	const uint64_t mantissa = (value >> (exponent - 2)) & 3;
+	return (exponent - 1) * 4 + mantissa;
+}
+
+static uint64_t getBucketMax(size_t bucket) {
+	if (bucket < 4) {
+		return bucket;
+	}
+	const int exponent = bucket / 4 + 1;
+	const uint64_t mantissa = bucket % 4;
+	return ((5 + mantissa) << (exponent - 2)) - 1;
+}
+
+void LatencyHistogram::add(uint64_t us) {
+	++this->_buckets[getBucket(us)];
+	++this->_count;
+	this->_max = std::max(this->_max, us);
+}
+
+uint64_t LatencyHistogram::getPercentile(double percentile) const {
+	// The number of values at or below the percentile, rounded up.
+	const uint64_t target = std::max((uint64_t)1,
+		(uint64_t)(this->_count * percentile / 100 + 0.999999));
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < NUM_BUCKETS; ++bucket) {
+		seen += this->_buckets[bucket];
+		if (seen >= target) {
+			// The bucket's upper bound might exceed anything actually recorded.
+			return std::min(getBucketMax(bucket), this->_max);
+		}
+	}
+	return this->_max;
+}
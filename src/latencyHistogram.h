@@ -0,0 +1,35 @@
+/*
+ * ReaKontrol
+ * Latency histogram header
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Records latencies in microseconds in fixed buckets, so that recording never
+// allocates. Bucket sizes grow exponentially, with 4 buckets per doubling, so
+// percentiles are accurate to within 25%.
+class LatencyHistogram {
+	public:
+	void add(uint64_t us);
+	uint64_t getCount() const {
+		return this->_count;
+	}
+	uint64_t getMax() const {
+		return this->_max;
+	}
+	// Returns the upper bound of the bucket containing the given percentile
+	// (0 to 100).
+	uint64_t getPercentile(double percentile) const;
+
+	private:
+	static constexpr size_t NUM_BUCKETS = 252;
+	std::array<uint64_t, NUM_BUCKETS> _buckets {};
+	uint64_t _count = 0;
+	uint64_t _max = 0;
+};
@@ -6,8 +6,13 @@
  * License: GNU General Public License version 2.0
  */
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <ctime>
+#include <iomanip>
 #include <regex>
+#include <sstream>
 #include <string>
 #ifdef _WIN32
 #include <windows.h>
@@ -19,6 +24,7 @@
 #endif
 #define REAPERAPI_IMPLEMENT
 #include "fxMap.h"
+#include "midiCapture.h"
 #include "reaKontrol.h"
 
 using namespace std;
@@ -41,6 +47,13 @@ const char* KKMK1_USB_PIDS[] = {"1340", "1350", "1360", "1410"};
 
 void (*osara_outputMessage)(const char* message) = nullptr;
 
+const char EXT_SECTION[] = "reaKontrol";
+const char EXT_KEY_OUTPUT_THREAD[] = "outputThread";
+const char EXT_KEY_INPUT_THREAD[] = "inputThread";
+
+// Used by the "Toggle MIDI capture" action.
+static MidiCapture midiCapture;
+
 int getKkMidiDevice(auto countFunc, auto getFunc) {
 	int count = countFunc();
 	log(count << " total devices");
@@ -133,7 +146,56 @@ const string getKkInstanceName(MediaTrack* track, bool stripPrefix) {
 	return "";
 }
 
-BaseSurface::BaseSurface(int inDev, int outDev) {
+// MIDI_event_t includes 4 bytes for the message, but we often need more. We
+// also pad frames so that the next frame in the queue is aligned.
+static size_t getFrameBufSize(size_t messageSize) {
+	const size_t size = sizeof(MIDI_event_t) - 4 + max(messageSize, (size_t)4);
+	constexpr size_t ALIGN = alignof(MIDI_event_t);
+	return (size + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+// The number of maximum size frames we reserve space for in the output queue.
+// A track bank change sends about 60 messages, most of them much smaller than
+// the maximum.
+constexpr size_t OUT_QUEUE_RESERVE_FRAMES = 64;
+// The number of bytes we send per Run(). Run() is called about 30 times a
+// second, so this is roughly 120 KB/s, which comfortably fits a track bank
+// change in a single Run() while keeping a slow link from being flooded.
+constexpr size_t OUT_BYTES_PER_RUN = 4096;
+
+static bool isSettingEnabled(const char* key) {
+	const char* value = GetExtState(EXT_SECTION, key);
+	return value && value[0] == '1';
+}
+
+int getIntSetting(const char* key, int defaultValue) {
+	const char* value = GetExtState(EXT_SECTION, key);
+	if (!value || !value[0]) {
+		return defaultValue;
+	}
+	return atoi(value);
+}
+
+// Run by the input thread to get the main thread to handle urgent input. This
+// posts our hidden command to REAPER's main window, which calls
+// handleMainCommand on the main thread.
+int CMD_HANDLE_INPUT = 0;
+static HWND mainHwnd = nullptr;
+
+static void wakeForInput() {
+	PostMessage(mainHwnd, WM_COMMAND, CMD_HANDLE_INPUT, 0);
+}
+
+BaseSurface::BaseSurface(int inDev, int outDev, size_t maxFrameSize,
+	bool (*isUrgentInput)(const MIDI_event_t*)
+) {
+	const size_t reserve = getFrameBufSize(maxFrameSize) *
+		OUT_QUEUE_RESERVE_FRAMES;
+	this->_outQueue.reserve(reserve);
+	this->_outQueueSpare.reserve(reserve);
+	for (auto& frames : this->_outFrames) {
+		frames.reserve(OUT_QUEUE_RESERVE_FRAMES);
+	}
 	this->_midiIn = CreateMIDIInput(inDev);
 	if (!this->_midiIn) {
 		log("CreateMIDIInput failed");
@@ -147,9 +209,39 @@ BaseSurface::BaseSurface(int inDev, int outDev) {
 		return;
 	}
 	this->_midiIn->start();
+	this->_lastInputSwapTime = getInputTime();
+	if (isUrgentInput && isSettingEnabled(EXT_KEY_INPUT_THREAD)) {
+		log("using input thread");
+		this->_inputThread = make_unique<InputThread>(this->_midiIn, isUrgentInput,
+			wakeForInput);
+	}
+	if (isSettingEnabled(EXT_KEY_OUTPUT_THREAD)) {
+		log("using output thread");
+		this->_outputThread = make_unique<OutputThread>(this->_midiOut);
+	}
 }
 
 BaseSurface::~BaseSurface() {
+	if (this->_inputThread) {
+		// Stop the thread before the input it uses is destroyed.
+#ifdef LOGGING
+		const InputThread::Stats stats = this->_inputThread->getStats();
+		log("input thread received " << stats.receivedMessages << " messages, "
+			<< stats.wakes << " wakes, " << stats.overflows << " overflows, max "
+			<< stats.maxUsed << " bytes buffered");
+#endif
+		this->_inputThread.reset();
+	}
+	if (this->_outputThread) {
+		// Stop the thread before the output it uses is destroyed.
+#ifdef LOGGING
+		const OutputThread::Stats stats = this->_outputThread->getStats();
+		log("output thread sent " << stats.sentMessages << " messages, "
+			<< stats.sentBytes << " bytes, " << stats.overflows << " overflows, max "
+			<< stats.maxUsed << " bytes buffered");
+#endif
+		this->_outputThread.reset();
+	}
 	if (this->_midiIn)  {
 		this->_midiIn->stop();
 		delete this->_midiIn;
@@ -163,15 +255,403 @@ void BaseSurface::Run() {
 	if (!this->_midiIn) {
 		return;
 	}
-	this->_midiIn->SwapBufs(timeGetTime());
-	MIDI_eventlist* list = this->_midiIn->GetReadBuf();
-	MIDI_event_t* evt;
-	int i = 0;
-	while ((evt = list->EnumItems(&i))) {
-		this->_onMidiEvent(evt);
+	this->handleInput();
+	this->_onMidiEventsDone();
+	// Send what was queued since the last Run(), including messages queued by
+	// other control surface callbacks.
+	this->_flushOutput(OUT_BYTES_PER_RUN);
+	if (midiCapture.isActive()) {
+		midiCapture.write(CAPTURE_RUN);
+	}
+}
+
+void BaseSurface::handleInput() {
+	if (!this->_midiIn) {
+		return;
+	}
+	if (this->_inputThread) {
+		this->_inputThread->handle([this](MIDI_event_t* event, uint64_t arrival) {
+			this->_handleInput(event, arrival);
+		});
+	} else {
+		const uint64_t swapTime = getInputTime();
+		this->_midiIn->SwapBufs(timeGetTime());
+		MIDI_eventlist* list = this->_midiIn->GetReadBuf();
+		MIDI_event_t* evt;
+		int i = 0;
+		while ((evt = list->EnumItems(&i))) {
+			this->_handleInput(evt,
+				getInputArrivalTime(evt, this->_lastInputSwapTime, swapTime));
+		}
+		this->_lastInputSwapTime = swapTime;
+	}
+}
+
+void BaseSurface::replayCapture(const filesystem::path& path) {
+	MidiCaptureReader reader(path);
+	if (!reader.isValid()) {
+		ShowConsoleMsg("ReaKontrol: not a valid MIDI capture file\n");
+		return;
+	}
+	uint64_t inMessages = 0;
+	uint64_t capturedMessages = 0;
+	uint64_t capturedBytes = 0;
+	const uint64_t startMessages = this->_sentMessages;
+	const uint64_t startBytes = this->_sentBytes;
+	chrono::steady_clock::duration handlerTime {};
+	this->_isReplaying = true;
+	MidiCaptureReader::Record record;
+	while (reader.next(record)) {
+		switch (record.type) {
+			case CAPTURE_IN: {
+				++inMessages;
+				const auto start = chrono::steady_clock::now();
+				this->_onMidiEvent(record.getEvent());
+				handlerTime += chrono::steady_clock::now() - start;
+				break;
+			}
+			case CAPTURE_OUT:
+				++capturedMessages;
+				capturedBytes += record.getEvent()->size;
+				break;
+			case CAPTURE_RUN: {
+				const auto start = chrono::steady_clock::now();
+				this->_onMidiEventsDone();
+				handlerTime += chrono::steady_clock::now() - start;
+				this->_flushOutput(OUT_BYTES_PER_RUN);
+				break;
+			}
+		}
+	}
+	this->_onMidiEventsDone();
+	this->_flushOutput();
+	this->_isReplaying = false;
+	const auto us = chrono::duration_cast<chrono::microseconds>(handlerTime).count();
+	ostringstream s;
+	s << "ReaKontrol replay of "
+		<< (const char*)path.filename().u8string().c_str() << ":\n"
+		<< inMessages << " input messages handled in " << us << " us";
+	if (inMessages) {
+		s << " (" << us / inMessages << " us each)";
+	}
+	s << "\noutput in capture: " << capturedMessages << " messages, "
+		<< capturedBytes << " bytes\n"
+		<< "output now: " << this->_sentMessages - startMessages << " messages, "
+		<< this->_sentBytes - startBytes << " bytes\n";
+	ShowConsoleMsg(s.str().c_str());
+}
+
+void BaseSurface::_handleInput(MIDI_event_t* event, uint64_t arrivalTime) {
+	if (midiCapture.isActive()) {
+		midiCapture.write(CAPTURE_IN, event);
+	}
+	// Get the key first, since the handler might change the message.
+	const uint16_t key = this->_getInputStatsKey(event);
+	this->_isHandlingInput = true;
+	this->_inputKey = key;
+	this->_inputArrivalTime = arrivalTime;
+	this->_inputDeferral = -1;
+	this->_onMidiEvent(event);
+	this->_isHandlingInput = false;
+	if (this->_inputDeferral >= 0) {
+		// This is recorded when the deferred work is done.
+		this->_deferredInputs[this->_inputDeferral].push_back({key, arrivalTime});
+		return;
+	}
+	const uint64_t now = getInputTime();
+	// Once a command has been seen, this doesn't allocate.
+	this->_inputLatency[key].add(now > arrivalTime ? now - arrivalTime : 0);
+}
+
+void BaseSurface::_deferInput(DeferredWork work) {
+	// Work later in the enum is done later, so that's when all of this input's
+	// work is done.
+	if (this->_isHandlingInput) {
+		this->_inputDeferral = max(this->_inputDeferral, (int)work);
+	}
+}
+
+void BaseSurface::_finishDeferredWork(DeferredWork work) {
+	vector<DeferredInput>& inputs = this->_deferredInputs[work];
+	if (inputs.empty()) {
+		return;
+	}
+	const uint64_t now = getInputTime();
+	for (const DeferredInput& input : inputs) {
+		this->_inputLatency[input.key].add(
+			now > input.arrivalTime ? now - input.arrivalTime : 0);
+	}
+	inputs.clear();
+}
+
+uint16_t BaseSurface::_getInputStatsKey(const MIDI_event_t* event) {
+	if (event->size < 2) {
+		return event->size ? event->midi_message[0] << 8 : 0;
+	}
+	return event->midi_message[0] << 8 | event->midi_message[1];
+}
+
+void BaseSurface::dumpPerfStats() {
+	ostringstream s;
+	s << "ReaKontrol performance statistics\n"
+		"Input latency in us from arrival until handled, by status and command.\n"
+		"This includes work which is deferred to the end of the Run(), such as\n"
+		"applying knob turns and following the selection, or to the next Run(),\n"
+		"such as refreshing the mixer bank after the track list changes:\n"
+		<< hex << setfill('0');
+	for (const auto& [key, histogram] : this->_inputLatency) {
+		s << setw(2) << (key >> 8) << " " << setw(2) << (key & 0xFF) << dec
+			<< ": " << histogram.getCount() << " messages, p50 "
+			<< histogram.getPercentile(50) << ", p99 "
+			<< histogram.getPercentile(99) << ", max " << histogram.getMax()
+			<< "\n" << hex;
+	}
+	s << dec << "Output: " << this->_sentMessages << " messages, "
+		<< this->_sentBytes << " bytes\n";
+	if (this->_inputThread) {
+		const InputThread::Stats stats = this->_inputThread->getStats();
+		s << "Input thread: " << stats.receivedMessages << " messages, "
+			<< stats.wakes << " wakes, " << stats.overflows << " overflows, max "
+			<< stats.maxUsed << " bytes buffered\n";
+	}
+	if (this->_outputThread) {
+		const OutputThread::Stats stats = this->_outputThread->getStats();
+		s << "Output thread: " << stats.sentMessages << " messages, "
+			<< stats.overflows << " overflows, max " << stats.maxUsed
+			<< " bytes buffered\n";
+	}
+	ShowConsoleMsg(s.str().c_str());
+}
+
+MIDI_event_t* BaseSurface::_getFrame(size_t size) {
+	// The queue never shrinks, so once it has grown to fit a busy Run(), this
+	// doesn't allocate.
+	this->_frameStart = this->_outQueue.size();
+	this->_outQueue.resize(this->_frameStart + getFrameBufSize(size));
+	auto event = (MIDI_event_t*)(this->_outQueue.data() + this->_frameStart);
+	event->frame_offset = 0;
+	event->size = size;
+	return event;
+}
+
+bool BaseSurface::_sendFrame(MIDI_event_t* event, uint32_t stateKey,
+	OutPriority priority
+) {
+	if (!this->_midiOut && !this->_isReplaying) {
+		this->_outQueue.resize(this->_frameStart);
+		return false;
+	}
+	this->_resetKeys.clear();
+	this->_getResetKeys(event, this->_resetKeys);
+	const bool isReset = !this->_resetKeys.empty();
+	DeviceState* state = nullptr;
+	// A message with the same key which is still queued and can be replaced.
+	// Messages with the same key always have the same priority, except for
+	// immediate messages.
+	QueuedFrame* pending = nullptr;
+	if (stateKey) {
+		state = &this->_deviceState[stateKey];
+		// Replacing a message queued before a reset would send the new value
+		// before the reset, which might then wipe it.
+		if (state->queue >= 0 && state->seq >= this->_outBarrier[state->queue]) {
+			pending = &this->_outFrames[state->queue][
+				state->seq - this->_outFramesStart[state->queue]];
+		}
+		if ((pending || state->queue < 0) && state->pendingResets == 0 &&
+				equal(state->shown.begin(), state->shown.end(), event->midi_message,
+				event->midi_message + event->size)) {
+			// The device already shows this and nothing queued will change that.
+			if (pending) {
+				// Sending the queued message would change it.
+				pending->offset = NO_FRAME;
+				state->queue = -1;
+			}
+			this->_outQueue.resize(this->_frameStart);
+			return false;
+		}
+	}
+	if (priority == OUT_IMMEDIATE) {
+		if (this->_send(event)) {
+			if (pending) {
+				// This supersedes the queued message.
+				pending->offset = NO_FRAME;
+				state->queue = -1;
+			}
+			this->_onFrameSent(state, event, isReset, /* wasQueued */ false);
+			// Remove the frame from the queue.
+			this->_outQueue.resize(this->_frameStart);
+			return true;
+		}
+		// The output thread is behind. Queue this ahead of everything except
+		// other feedback.
+		priority = OUT_FEEDBACK;
+	}
+	if (pending) {
+		if (!isReset) {
+			// Replace the queued message, keeping its place in the queue.
+			pending->offset = this->_frameStart;
+			return true;
+		}
+		// A reset must be sent after everything queued before it, so it can't
+		// take the place of the queued message. Drop that message instead.
+		pending->offset = NO_FRAME;
+	}
+	const int queue = priority - OUT_FEEDBACK;
+	vector<QueuedFrame>& frames = this->_outFrames[queue];
+	const uint64_t seq = this->_outFramesStart[queue] + frames.size();
+	frames.push_back({stateKey, this->_frameStart, isReset});
+	if (state) {
+		state->queue = queue;
+		state->seq = seq;
+	}
+	if (isReset || !stateKey) {
+		// Messages without a key might also reset what the device shows, so they
+		// are barriers too.
+		this->_outBarrier[queue] = seq + 1;
+		for (const uint32_t key : this->_resetKeys) {
+			++this->_deviceState[key].pendingResets;
+		}
+	}
+	return true;
+}
+
+bool BaseSurface::_send(MIDI_event_t* event) {
+#ifdef LOGGING
+	ostringstream s;
+	s << "send" << hex << showbase;
+	for (int i = 0; i < event->size; ++i) {
+		s << " " << (int)event->midi_message[i];
+	}
+	s << endl;
+	ShowConsoleMsg(s.str().c_str());
+#endif
+	if (this->_outputThread) {
+		if (!this->_outputThread->push(event)) {
+			return false;
+		}
+	} else if (this->_midiOut) {
+		this->_midiOut->SendMsg(event, -1);
+	}
+	// Otherwise, this is a replay without a device, so we just count it.
+	++this->_sentMessages;
+	this->_sentBytes += event->size;
+	if (midiCapture.isActive()) {
+		midiCapture.write(CAPTURE_OUT, event);
+	}
+	return true;
+}
+
+MIDI_event_t* BaseSurface::_getQueuedFrame(const QueuedFrame& frame) {
+	return (MIDI_event_t*)(this->_outQueue.data() + frame.offset);
+}
+
+void BaseSurface::_onFrameSent(DeviceState* state, MIDI_event_t* event,
+	bool isReset, bool wasQueued
+) {
+	if (state) {
+		// This doesn't allocate unless the message is longer than the last one
+		// sent with this key.
+		state->shown.assign(event->midi_message,
+			event->midi_message + event->size);
+	}
+	if (!isReset) {
+		return;
+	}
+	this->_resetKeys.clear();
+	this->_getResetKeys(event, this->_resetKeys);
+	for (const uint32_t key : this->_resetKeys) {
+		DeviceState& reset = this->_deviceState[key];
+		// Keep the buffer so that it can be reused.
+		reset.shown.clear();
+		if (wasQueued) {
+			--reset.pendingResets;
+		}
+	}
+}
+
+void BaseSurface::_flushOutput(size_t maxBytes) {
+	size_t sentBytes = 0;
+	bool full = false;
+	for (int queue = 0; queue < OUT_NUM_PRIORITIES - 1; ++queue) {
+		vector<QueuedFrame>& frames = this->_outFrames[queue];
+		auto frame = frames.begin();
+		for (; frame != frames.end(); ++frame) {
+			if (frame->offset == NO_FRAME) {
+				continue;
+			}
+			MIDI_event_t* event = this->_getQueuedFrame(*frame);
+			if ((sentBytes > 0 && sentBytes + event->size > maxBytes) ||
+					!this->_send(event)) {
+				full = true;
+				break;
+			}
+			sentBytes += event->size;
+			DeviceState* state = nullptr;
+			if (frame->stateKey) {
+				state = &this->_deviceState[frame->stateKey];
+				if (state->queue == queue && state->seq ==
+						this->_outFramesStart[queue] + (frame - frames.begin())) {
+					state->queue = -1;
+				}
+			}
+			this->_onFrameSent(state, event, frame->isReset, /* wasQueued */ true);
+		}
+		this->_outFramesStart[queue] += frame - frames.begin();
+		frames.erase(frames.begin(), frame);
+		if (full) {
+			break;
+		}
+	}
+	if (!full) {
+		this->_outQueue.clear();
+		return;
+	}
+	// Some frames are still queued. Compact the queue so that it doesn't keep
+	// growing with replaced and sent frames.
+	this->_outQueueSpare.clear();
+	for (auto& frames : this->_outFrames) {
+		for (QueuedFrame& frame : frames) {
+			if (frame.offset == NO_FRAME) {
+				continue;
+			}
+			MIDI_event_t* event = this->_getQueuedFrame(frame);
+			const size_t size = getFrameBufSize(event->size);
+			const size_t offset = this->_outQueueSpare.size();
+			this->_outQueueSpare.insert(this->_outQueueSpare.end(),
+				(unsigned char*)event, (unsigned char*)event + size);
+			frame.offset = offset;
+		}
+	}
+	this->_outQueue.swap(this->_outQueueSpare);
+}
+
+void BaseSurface::_drainOutput() {
+	for (; ;) {
+		this->_flushOutput();
+		if (this->_outputThread) {
+			this->_outputThread->drain();
+		}
+		if (all_of(begin(this->_outFrames), end(this->_outFrames),
+				[](const auto& frames) { return frames.empty(); })) {
+			break;
+		}
+		// The output thread's buffer filled up, so we need to go again.
+	}
+}
+
+void BaseSurface::_resetDeviceState() {
+	for (auto& [key, state] : this->_deviceState) {
+		// Keep the buffer so that it can be reused.
+		state.shown.clear();
 	}
 }
 
+void BaseSurface::_sendRaw(string_view message) {
+	MIDI_event_t* event = this->_getFrame(message.length());
+	memcpy(event->midi_message, message.data(), message.length());
+	this->_sendFrame(event);
+}
+
 IReaperControlSurface* surface = nullptr;
 
 void connect() {
@@ -196,6 +676,7 @@ void connect() {
 }
 
 void disconnect() {
+	midiCapture.stop();
 	if (surface) {
 		log("disconnecting");
 		plugin_register("-csurf_inst", (void*)surface);
@@ -206,6 +687,78 @@ void disconnect() {
 
 int CMD_RECONNECT = 0;
 int CMD_GENERATE_FX_MAP = 0;
+int CMD_TOGGLE_OUTPUT_THREAD = 0;
+int CMD_TOGGLE_INPUT_THREAD = 0;
+int CMD_TOGGLE_CAPTURE = 0;
+int CMD_REPLAY_CAPTURE = 0;
+int CMD_DUMP_PERF_STATS = 0;
+
+static filesystem::path getCaptureDir() {
+	filesystem::path path(u8string_view((char8_t*)GetResourcePath()));
+	path /= "reaKontrol";
+	path /= "captures";
+	return path;
+}
+
+static void toggleCapture() {
+	if (midiCapture.isActive()) {
+		midiCapture.stop();
+		if (osara_outputMessage) {
+			osara_outputMessage("stopped MIDI capture");
+		}
+		return;
+	}
+	// Name the file after the current date and time; e.g.
+	// 20260131-143000.rkmc.
+	char name[32];
+	const time_t now = time(nullptr);
+	strftime(name, sizeof(name), "%Y%m%d-%H%M%S.rkmc", localtime(&now));
+	if (midiCapture.start(getCaptureDir() / name) && osara_outputMessage) {
+		osara_outputMessage("started MIDI capture");
+	}
+}
+
+static void replayCapture() {
+	const string dir = (const char*)getCaptureDir().u8string().c_str();
+	char fn[4096];
+	strncpy(fn, dir.c_str(), sizeof(fn) - 1);
+	fn[sizeof(fn) - 1] = '\0';
+	if (!GetUserFileNameForRead(fn, "Replay MIDI capture", "rkmc")) {
+		return;
+	}
+	// The captured commands are run against the current project, just as they
+	// were when the keyboard sent them.
+	if (ShowMessageBox(
+		"Replaying a capture performs the captured commands in the current "
+		"project, just as the keyboard did. For example, it might change volumes, "
+		"mute tracks, change FX parameters or start playback. You should only "
+		"replay in a project you don't mind changing; e.g. a copy.\n\n"
+		"Replay anyway?",
+		"ReaKontrol", MB_OKCANCEL) != IDOK) {
+		return;
+	}
+	// Replay through a new surface without devices. That way, the keyboard
+	// doesn't need to be connected, nothing is sent to it and the result doesn't
+	// depend on what the connected surface has already sent. This surface isn't
+	// registered with REAPER, so it doesn't get REAPER's callbacks.
+	unique_ptr<IReaperControlSurface> offline(isMk1Connected() ?
+		createMcuSurface(-1, -1) : createNiMidiSurface(-1, -1));
+	// All surfaces we create are BaseSurfaces.
+	static_cast<BaseSurface*>(offline.get())->replayCapture(
+		filesystem::path(u8string_view((char8_t*)fn)));
+}
+
+static void toggleThreadSetting(const char* key, const char* name) {
+	const bool enable = !isSettingEnabled(key);
+	SetExtState(EXT_SECTION, key, enable ? "1" : "0", true);
+	if (osara_outputMessage) {
+		osara_outputMessage(
+			(string(enable ? "enabled " : "disabled ") + name).c_str());
+	}
+	// The surface only checks this when it is created.
+	disconnect();
+	connect();
+}
 
 bool handleCommand(KbdSectionInfo* section, int command, int val, int valHw,
 	int relMode, HWND hwnd
@@ -219,6 +772,43 @@ bool handleCommand(KbdSectionInfo* section, int command, int val, int valHw,
 		FxMap::generateMapFileForSelectedFx();
 		return true;
 	}
+	if (command == CMD_TOGGLE_CAPTURE) {
+		toggleCapture();
+		return true;
+	}
+	if (command == CMD_REPLAY_CAPTURE) {
+		replayCapture();
+		return true;
+	}
+	if (command == CMD_DUMP_PERF_STATS) {
+		if (surface) {
+			// All surfaces we create are BaseSurfaces.
+			static_cast<BaseSurface*>(surface)->dumpPerfStats();
+		}
+		return true;
+	}
+	if (command == CMD_TOGGLE_OUTPUT_THREAD) {
+		toggleThreadSetting(EXT_KEY_OUTPUT_THREAD, "output thread");
+		return true;
+	}
+	if (command == CMD_TOGGLE_INPUT_THREAD) {
+		toggleThreadSetting(EXT_KEY_INPUT_THREAD, "input thread");
+		return true;
+	}
+	return false;
+}
+
+// Our hidden commands aren't in the action list, so they don't go through
+// hookcommand2.
+bool handleMainCommand(int command, int flag) {
+	if (command == CMD_HANDLE_INPUT) {
+		// Only handle the input. The rest of Run(), such as meters and sending
+		// queued feedback, can wait until REAPER next calls it.
+		if (surface) {
+			static_cast<BaseSurface*>(surface)->handleInput();
+		}
+		return true;
+	}
 	return false;
 }
 
@@ -236,6 +826,9 @@ REAPER_PLUGIN_DLL_EXPORT int REAPER_PLUGIN_ENTRYPOINT(REAPER_PLUGIN_HINSTANCE hI
 		if (rec->caller_version != REAPER_PLUGIN_VERSION || !rec->GetFunc || REAPERAPI_LoadAPI(rec->GetFunc) != 0) {
 			return 0; // Incompatible.
 		}
+		mainHwnd = GetMainHwnd();
+		CMD_HANDLE_INPUT = rec->Register("command_id",
+			(void*)"REAKONTROL_HANDLEINPUT");
 		connect();
 		const int MAIN_SECTION = 0;
 		custom_action_register_t action = {MAIN_SECTION, "REAKONTROL_RECONNECT",
@@ -244,7 +837,23 @@ REAPER_PLUGIN_DLL_EXPORT int REAPER_PLUGIN_ENTRYPOINT(REAPER_PLUGIN_HINSTANCE hI
 		action = {MAIN_SECTION, "REAKONTROL_GENFXMAP",
 			"ReaKontrol: Generate map file for selected FX"};
 		CMD_GENERATE_FX_MAP = rec->Register("custom_action", &action);
+		action = {MAIN_SECTION, "REAKONTROL_TOGGLEOUTPUTTHREAD",
+			"ReaKontrol: Toggle sending MIDI on a separate thread"};
+		CMD_TOGGLE_OUTPUT_THREAD = rec->Register("custom_action", &action);
+		action = {MAIN_SECTION, "REAKONTROL_TOGGLEINPUTTHREAD",
+			"ReaKontrol: Toggle reading MIDI on a separate thread"};
+		CMD_TOGGLE_INPUT_THREAD = rec->Register("custom_action", &action);
+		action = {MAIN_SECTION, "REAKONTROL_TOGGLECAPTURE",
+			"ReaKontrol: Toggle MIDI capture"};
+		CMD_TOGGLE_CAPTURE = rec->Register("custom_action", &action);
+		action = {MAIN_SECTION, "REAKONTROL_REPLAYCAPTURE",
+			"ReaKontrol: Replay MIDI capture"};
+		CMD_REPLAY_CAPTURE = rec->Register("custom_action", &action);
+		action = {MAIN_SECTION, "REAKONTROL_DUMPPERFSTATS",
+			"ReaKontrol: Dump performance statistics"};
+		CMD_DUMP_PERF_STATS = rec->Register("custom_action", &action);
 		rec->Register("hookcommand2", (void*)handleCommand);
+		rec->Register("hookcommand", (void*)handleMainCommand);
 		rec->Register("timer", (void*)delayedInit);
 		return 1;
 	} else {
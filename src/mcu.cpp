@@ -8,7 +8,6 @@
 
 #include <string>
 #include <sstream>
-#include <cstring>
 #include "reaKontrol.h"
 
 using namespace std;
@@ -21,6 +20,16 @@ const unsigned char MIDI_SYSEX_BEGIN[] = {
 	0xF0, 0x00, 0x00, 0x66, 0x14, 0x12, 0x00};
 const unsigned char MIDI_SYSEX_SEPARATOR = 0x19;
 const unsigned char MIDI_SYSEX_END = 0xF7;
+// The largest message we send is the track name and instance sysex. Track
+// names can in theory be longer than this, but that is rare and just means we
+// grow the frame buffer once.
+constexpr size_t MAX_TRACK_NAME = 128;
+constexpr size_t MAX_FRAME_SIZE = sizeof(MIDI_SYSEX_BEGIN)
+	+ MAX_TRACK_NAME
+	+ 1 + 10 // separator, track id
+	+ 1 + sizeof("Komplete Kontrol VST") // separator, plugin name
+	+ 10 // instance number
+	+ sizeof(MIDI_SYSEX_END);
 
 const unsigned char CMD_NAV_LEFT = 0x14;
 const unsigned char CMD_NAV_RIGHT = 0x15;
@@ -30,10 +39,26 @@ const unsigned char CMD_STOP = 0x5D;
 const unsigned char CMD_PLAY = 0x5E;
 const unsigned char CMD_RECORD = 0x5F;
 
+// Transport buttons, which the user expects to act straight away. This is
+// called on the input thread.
+static bool isUrgentInput(const MIDI_event_t* event) {
+	if (event->size != 3 || event->midi_message[0] != MIDI_NOTE_ON ||
+			event->midi_message[2] == MIDI_VAL_OFF) {
+		return false;
+	}
+	switch (event->midi_message[1]) {
+		case CMD_STOP:
+		case CMD_PLAY:
+		case CMD_RECORD:
+			return true;
+	}
+	return false;
+}
+
 class McuSurface: public BaseSurface {
 	public:
 	McuSurface(int inDev, int outDev)
-	: BaseSurface(inDev, outDev) {
+	: BaseSurface(inDev, outDev, MAX_FRAME_SIZE, isUrgentInput) {
 	}
 
 	virtual const char* GetTypeString() override {
@@ -100,28 +125,6 @@ class McuSurface: public BaseSurface {
 		message += MIDI_SYSEX_END;
 		this->_sendRaw(message);
 	}
-
-	private:
-	void _sendRaw(const string& message) {
-		// MIDI_event_t includes 4 bytes for the message, but we need more.
-		MIDI_event_t* event = (MIDI_event_t*)new unsigned char[
-			sizeof(MIDI_event_t) - 4 + message.length()];
-		event->frame_offset = 0;
-		event->size = message.length();
-		memcpy(event->midi_message, message.c_str(), message.length());
-#ifdef LOGGING
-		ostringstream s;
-		s << "send raw" << hex << showbase;
-		for (int i = 0; i < event->size; ++i) {
-			s << " " << (int)event->midi_message[i];
-		}
-		s << endl;
-		ShowConsoleMsg(s.str().c_str());
-#endif
-		this->_midiOut->SendMsg(event, -1);
-		delete event;
-	}
-
 };
 
 IReaperControlSurface* createMcuSurface(int inDev, int outDev) {
@@ -0,0 +1,93 @@
+/*
+ * ReaKontrol
+ * MIDI capture code
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "midiCapture.h"
+#include "reaKontrol.h"
+
+static void writeUint32(std::ofstream& file, uint32_t value) {
+	unsigned char bytes[4];
+	for (int b = 0; b < 4; ++b) {
+		bytes[b] = (value >> (b * 8)) & 0xFF;
+	}
+	file.write((char*)bytes, sizeof(bytes));
+}
+
+static bool readUint32(std::ifstream& file, uint32_t& value) {
+	unsigned char bytes[4];
+	if (!file.read((char*)bytes, sizeof(bytes))) {
+		return false;
+	}
+	value = 0;
+	for (int b = 0; b < 4; ++b) {
+		value |= (uint32_t)bytes[b] << (b * 8);
+	}
+	return true;
+}
+
+bool MidiCapture::start(const std::filesystem::path& path) {
+	this->stop();
+	std::filesystem::create_directories(path.parent_path());
+	this->_file.open(path, std::ios::binary);
+	if (!this->_file) {
+		log("couldn't open capture file " << path);
+		return false;
+	}
+	this->_file.write(MIDI_CAPTURE_MAGIC, sizeof(MIDI_CAPTURE_MAGIC));
+	this->_file.put(MIDI_CAPTURE_VERSION);
+	this->_startTime = timeGetTime();
+	log("capturing to " << path);
+	return true;
+}
+
+void MidiCapture::stop() {
+	if (this->_file.is_open()) {
+		this->_file.close();
+	}
+}
+
+void MidiCapture::write(MidiCaptureRecordType type, const MIDI_event_t* event) {
+	this->_file.put(type);
+	writeUint32(this->_file, timeGetTime() - this->_startTime);
+	const uint32_t size = event ? event->size : 0;
+	writeUint32(this->_file, size);
+	if (size) {
+		this->_file.write((const char*)event->midi_message, size);
+	}
+}
+
+MidiCaptureReader::MidiCaptureReader(const std::filesystem::path& path)
+: _file(path, std::ios::binary) {
+	char magic[sizeof(MIDI_CAPTURE_MAGIC)];
+	if (!this->_file.read(magic, sizeof(magic)) ||
+			memcmp(magic, MIDI_CAPTURE_MAGIC, sizeof(magic)) != 0) {
+		return;
+	}
+	this->_valid = this->_file.get() == MIDI_CAPTURE_VERSION;
+}
+
+bool MidiCaptureReader::next(Record& record) {
+	const int type = this->_file.get();
+	if (type == EOF) {
+		return false;
+	}
+	record.type = (MidiCaptureRecordType)type;
+	uint32_t size;
+	if (!readUint32(this->_file, record.time) || !readUint32(this->_file, size) ||
+			size > MIDI_CAPTURE_MAX_MESSAGE_SIZE) {
+		return false;
+	}
+	// MIDI_event_t includes 4 bytes for the message, but we might need more.
+	record.event.resize(sizeof(MIDI_event_t) - 4 + std::max(size, (uint32_t)4));
+	MIDI_event_t* event = record.getEvent();
+	event->frame_offset = 0;
+	event->size = size;
+	return size == 0 ||
+		(bool)this->_file.read((char*)event->midi_message, size);
+}
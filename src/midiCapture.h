@@ -0,0 +1,75 @@
+/*
+ * ReaKontrol
+ * MIDI capture header
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <reaper/reaper_plugin.h>
+
+// Capture files start with this, followed by a version byte. Each record is a
+// type byte, a 32 bit timestamp in ms since the capture started, a 32 bit
+// message size and the message bytes. Integers are little endian.
+constexpr char MIDI_CAPTURE_MAGIC[] = {'R', 'K', 'M', 'C'};
+constexpr unsigned char MIDI_CAPTURE_VERSION = 1;
+// No real message is anywhere near this big, so a larger size means the file
+// is corrupt.
+constexpr uint32_t MIDI_CAPTURE_MAX_MESSAGE_SIZE = 64 * 1024;
+
+enum MidiCaptureRecordType: unsigned char {
+	// A message received from the device.
+	CAPTURE_IN,
+	// A message sent to the device.
+	CAPTURE_OUT,
+	// The end of a Run() call. There is no message.
+	CAPTURE_RUN,
+};
+
+// Records MIDI traffic between REAPER and the device to a file.
+class MidiCapture {
+	public:
+	bool start(const std::filesystem::path& path);
+	void stop();
+	bool isActive() const {
+		return this->_file.is_open();
+	}
+	void write(MidiCaptureRecordType type, const MIDI_event_t* event = nullptr);
+
+	private:
+	std::ofstream _file;
+	unsigned int _startTime = 0;
+};
+
+// Reads a file written by MidiCapture.
+class MidiCaptureReader {
+	public:
+	MidiCaptureReader(const std::filesystem::path& path);
+	bool isValid() const {
+		return this->_valid;
+	}
+
+	struct Record {
+		MidiCaptureRecordType type;
+		uint32_t time;
+		// A MIDI_event_t with room for the message.
+		std::vector<unsigned char> event;
+
+		MIDI_event_t* getEvent() {
+			return (MIDI_event_t*)this->event.data();
+		}
+	};
+	// Read the next record into record, reusing its buffer. Returns false at the
+	// end of the file or if the file is truncated or corrupt.
+	bool next(Record& record);
+
+	private:
+	std::ifstream _file;
+	bool _valid = false;
+};
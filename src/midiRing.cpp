@@ -0,0 +1,101 @@
+/*
+ * ReaKontrol
+ * MIDI ring buffer code
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "midiRing.h"
+
+constexpr size_t EVENT_HEADER_SIZE = sizeof(MIDI_event_t) - 4;
+// Each record is the timestamp followed by the MIDI_event_t.
+constexpr size_t RECORD_HEADER_SIZE = sizeof(uint64_t) + EVENT_HEADER_SIZE;
+constexpr size_t RECORD_ALIGN = alignof(uint64_t);
+
+// Records are padded so that the next record is aligned.
+static size_t getRecordSize(const MIDI_event_t* event) {
+	const size_t size = RECORD_HEADER_SIZE + std::max(event->size, 4);
+	return (size + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN;
+}
+
+static MIDI_event_t* getRecordEvent(unsigned char* record) {
+	return (MIDI_event_t*)(record + sizeof(uint64_t));
+}
+
+MidiRing::MidiRing(size_t size): _ring(size) {
+}
+
+bool MidiRing::canFit(const MIDI_event_t* event) const {
+	return getRecordSize(event) <= this->_ring.size();
+}
+
+bool MidiRing::push(const MIDI_event_t* event, uint64_t time) {
+	const size_t ringSize = this->_ring.size();
+	const size_t recordSize = getRecordSize(event);
+	size_t writePos = this->_writePos.load(std::memory_order_relaxed);
+	const size_t readPos = this->_readPos.load(std::memory_order_acquire);
+	// A record must be contiguous. If it won't fit before the end of the ring,
+	// we skip to the start.
+	const size_t offset = writePos % ringSize;
+	const size_t untilEnd = ringSize - offset;
+	const size_t skip = untilEnd < recordSize ? untilEnd : 0;
+	const size_t used = writePos - readPos;
+	if (used + skip + recordSize > ringSize) {
+		return false;
+	}
+	if (skip) {
+		if (skip >= RECORD_HEADER_SIZE) {
+			// Write an empty message to tell the consumer to skip to the start. If
+			// there's no room for that, the consumer knows to skip anyway.
+			getRecordEvent(this->_ring.data() + offset)->size = 0;
+		}
+		writePos += skip;
+	}
+	unsigned char* record = this->_ring.data() + writePos % ringSize;
+	memcpy(record, &time, sizeof(time));
+	memcpy(getRecordEvent(record), event, EVENT_HEADER_SIZE + event->size);
+	writePos += recordSize;
+	if (writePos - readPos > this->_maxUsed.load(std::memory_order_relaxed)) {
+		this->_maxUsed.store(writePos - readPos, std::memory_order_relaxed);
+	}
+	this->_writePos.store(writePos, std::memory_order_release);
+	return true;
+}
+
+MIDI_event_t* MidiRing::front(uint64_t* time) {
+	const size_t ringSize = this->_ring.size();
+	const size_t writePos = this->_writePos.load(std::memory_order_acquire);
+	size_t readPos = this->_readPos.load(std::memory_order_relaxed);
+	while (readPos != writePos) {
+		const size_t offset = readPos % ringSize;
+		const size_t untilEnd = ringSize - offset;
+		unsigned char* record = this->_ring.data() + offset;
+		if (untilEnd < RECORD_HEADER_SIZE || getRecordEvent(record)->size == 0) {
+			// The next message is at the start of the ring. Publish the skip, so that
+			// the producer can reuse the space and isEmpty is accurate.
+			readPos += untilEnd;
+			this->_readPos.store(readPos, std::memory_order_release);
+			continue;
+		}
+		if (time) {
+			memcpy(time, record, sizeof(*time));
+		}
+		return getRecordEvent(record);
+	}
+	return nullptr;
+}
+
+void MidiRing::pop() {
+	const size_t readPos = this->_readPos.load(std::memory_order_relaxed);
+	unsigned char* record = this->_ring.data() + readPos % this->_ring.size();
+	this->_readPos.store(readPos + getRecordSize(getRecordEvent(record)),
+		std::memory_order_release);
+}
+
+bool MidiRing::isEmpty() const {
+	return this->_readPos.load(std::memory_order_acquire) ==
+		this->_writePos.load(std::memory_order_acquire);
+}
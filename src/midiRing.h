@@ -0,0 +1,46 @@
+/*
+ * ReaKontrol
+ * MIDI ring buffer header
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <reaper/reaper_plugin.h>
+
+// A fixed size, lock-free, single producer, single consumer ring buffer of
+// MIDI messages, used to pass messages between threads. Messages are stored as
+// complete MIDI_event_t structures, so the consumer can use them without
+// copying. Each message also has a timestamp, which is up to the user.
+class MidiRing {
+	public:
+	MidiRing(size_t size);
+	// Whether a message could ever fit in the buffer.
+	bool canFit(const MIDI_event_t* event) const;
+	// Only the producer may call this. Returns false if there isn't enough room.
+	bool push(const MIDI_event_t* event, uint64_t time = 0);
+	// Only the consumer may call this. Returns the oldest message, or nullptr if
+	// there are none. The message remains valid until pop is called.
+	MIDI_event_t* front(uint64_t* time = nullptr);
+	// Only the consumer may call this, after front returned a message.
+	void pop();
+	bool isEmpty() const;
+	// The most bytes that have been used at once.
+	size_t getMaxUsed() const {
+		return this->_maxUsed;
+	}
+
+	private:
+	std::vector<unsigned char> _ring;
+	// These are byte counts which only ever increase. The position in _ring is
+	// the count modulo the ring size. _writePos is only written by the producer
+	// and _readPos is only written by the consumer.
+	std::atomic<size_t> _writePos = 0;
+	std::atomic<size_t> _readPos = 0;
+	std::atomic<size_t> _maxUsed = 0;
+};
@@ -8,20 +8,32 @@
  */
 
 #include <algorithm>
+#include <array>
+#include <map>
+#include <span>
 #include <string>
 #include <sstream>
+#include <unordered_map>
 #include <vector>
 #include <WDL/db2val.h>
 #include <cstring>
+#include "dispatch.h"
 #include "fxMap.h"
+#include "niSysex.h"
 #include "reaKontrol.h"
+#include "volCc.h"
 
 using namespace std;
 
 const unsigned char MIDI_CC = 0xBF;
-const unsigned char MIDI_SYSEX_BEGIN[] = {
-	0xF0, 0x00, 0x21, 0x09, 0x00, 0x00, 0x44, 0x43, 0x01, 0x00};
-const unsigned char MIDI_SYSEX_END = 0xF7;
+// The longest info we normally send is a name or value text, which REAPER
+// gives us in 100 byte buffers. Plug-in name lists can be longer, but those just
+// grow the frame buffer once.
+constexpr size_t MAX_SYSEX_INFO = 100;
+constexpr size_t MAX_FRAME_SIZE = sizeof(MIDI_SYSEX_BEGIN)
+	+ 3 // command, value, track
+	+ MAX_SYSEX_INFO
+	+ sizeof(MIDI_SYSEX_END);
 
 const unsigned char CMD_HELLO = 0x01;
 const unsigned char CMD_GOODBYE = 0x02;
@@ -108,6 +120,36 @@ const unsigned char PARAM_GROUP_VOLUME = 0;
 const unsigned char PARAM_GROUP_PAN = 1;
 const unsigned char PARAM_GROUP_PLUGIN = 2;
 
+// Device state keys. See BaseSurface::_sendFrame.
+constexpr uint32_t STATE_KEY_CC = 1 << 16;
+constexpr uint32_t STATE_KEY_SYSEX = 2 << 16;
+
+// How often we update the level meters.
+constexpr DWORD METER_INTERVAL = 50;
+// How many meter updates a peak is held for before it starts to fall.
+constexpr int METER_HOLD_UPDATES = 10;
+// How far a meter falls per update once its hold has expired.
+constexpr unsigned char METER_DECAY_STEP = 4;
+// How many slots of the neighbouring banks we query REAPER for in each Run().
+// This keeps the work done in a single Run() small, but both neighbours are
+// still ready within a few Run() calls of a bank change.
+constexpr int PREFETCH_SLOTS_PER_RUN = 4;
+// How many times a second we send FX parameter values which REAPER reports
+// have changed; e.g. during automation playback. REAPER reports these for
+// every audio block, which would flood the MIDI link. This can be overridden
+// with the fxParamRate setting.
+const char EXT_KEY_FX_PARAM_RATE[] = "fxParamRate";
+constexpr int DEFAULT_FX_PARAM_RATE = 30;
+// When the user turns a knob, the keyboard moves the knob's position itself.
+// REAPER then reports the change back to us, but sending the position again
+// would just double the traffic. For this long after we last changed a knob's
+// value, we don't send its position. We send the final position once this has
+// passed, in case REAPER adjusted it.
+constexpr DWORD KNOB_ECHO_WINDOW = 200;
+// While we aren't sending a knob's position, we still send its value text,
+// but at most this often.
+constexpr DWORD KNOB_ECHO_TEXT_INTERVAL = 100;
+
 const double CC_PAN_SCALE_FACTOR = 127 * 8;
 constexpr double TEN_NS_IN_SEC = 10e-9;
 
@@ -120,7 +162,9 @@ signed char convertSignedMidiValue(unsigned char value) {
 	return value - 128;
 }
 
-unsigned char volToCc(double volume) {
+// This is exact, but slow, since it needs logs and a call into REAPER. We only
+// use it to build the thresholds for volToCc.
+unsigned char volToCcExact(double volume) {
 	// Based on:
 	// https://github.com/justinfrankel/reaper-sdk/blob/cde283eea2d82e19e473062649a95dc0e799fe37/reaper-plugins/reaper_csurf/csurf_01X.cpp#LL286
 	// CC values range from 0 to 127. DB2SLIDER returns a value from 0 to 1000.
@@ -130,28 +174,209 @@ unsigned char volToCc(double volume) {
 	return (unsigned char)(val + 0.5);
 }
 
-unsigned char panToCc(double pan) {
-	// Based on:
-	// https://github.com/justinfrankel/reaper-sdk/blob/cde283eea2d82e19e473062649a95dc0e799fe37/reaper-plugins/reaper_csurf/csurf_01X.cpp#LL295
-	// Pan ranges from -1 to 1, so add 1 to give us a range of 0 to 2. Then
-	// divide by 2 to give us a fraction of 1. Finally, CC values range from 0 to
-	// 127, so multiply to scale accordingly.
-	double val = (pan + 1.0) / 2.0 * 127.0;
-	val = clamp(val, 0.0, 127.0);
-	// Round >= 0.5 up to 1.
-	return (unsigned char)(val + 0.5);
+const VolCcThresholds& getVolCcThresholds() {
+	// This is built the first time we need it, since it needs REAPER's API.
+	static const VolCcThresholds thresholds = makeVolCcThresholds(volToCcExact);
+	return thresholds;
+}
+
+unsigned char volToCc(double volume) {
+	return volToCc(getVolCcThresholds(), volume);
+}
+
+// Convert a peak level to a meter value, using the same scale as the volume
+// knobs. 0 terminates the list of meter values, so the minimum is 1.
+unsigned char peakToMeter(double peak) {
+	return max(volToCc(peak), (unsigned char)1);
+}
+
+uint32_t getCcStateKey(unsigned char command) {
+	switch (command) {
+		case CMD_HELLO:
+		case CMD_GOODBYE:
+		case CMD_USE_SYSEX_PARAM:
+			// These are requests, not state.
+			return 0;
+	}
+	return STATE_KEY_CC | command;
+}
+
+bool isSysexForSlot(unsigned char command) {
+	switch (command) {
+		case CMD_TRACK_AVAIL:
+		case CMD_TRACK_SELECTED:
+		case CMD_TRACK_MUTED:
+		case CMD_TRACK_SOLOED:
+		case CMD_TRACK_ARMED:
+		case CMD_TRACK_VOLUME_TEXT:
+		case CMD_TRACK_PAN_TEXT:
+		case CMD_TRACK_NAME:
+		case CMD_TRACK_VU:
+		case CMD_PARAM_NAME:
+		case CMD_PARAM_VALUE_TEXT:
+		case CMD_PARAM_SECTION:
+			return true;
+	}
+	return false;
 }
 
+uint32_t getSysexStateKey(unsigned char command, unsigned char index) {
+	switch (command) {
+		case CMD_SURFACE_CONFIG:
+		case CMD_SEL_TRACK_PARAMS_CHANGED:
+		case CMD_SELECT_PLUGIN:
+			// These trigger actions on the device, which might also be triggered by the
+			// user, so we can't know whether they've already been done.
+			return 0;
+	}
+	if (!isSysexForSlot(command)) {
+		// The index isn't a slot; e.g. it's a page number. There is only one of these
+		// on the device.
+		index = 0;
+	}
+	return STATE_KEY_SYSEX | command << 8 | index;
+}
+
+OutPriority getSysexPriority(unsigned char command) {
+	switch (command) {
+		case CMD_TRACK_VOLUME_TEXT:
+		case CMD_TRACK_PAN_TEXT:
+		case CMD_TRACK_VU:
+		case CMD_PARAM_VALUE_TEXT:
+			return OUT_VALUE;
+		case CMD_TRACK_NAME:
+		case CMD_PARAM_SECTION:
+		case CMD_PRESET_NAME:
+			return OUT_BULK;
+	}
+	// Flags, as well as messages which reset or restructure what the device
+	// shows; e.g. slot availability, parameter names and plug-in selection.
+	// These must be sent before names and values which depend on them.
+	return OUT_FEEDBACK;
+}
+
+// Transport buttons, which the user expects to act straight away. This is
+// called on the input thread.
+static bool isUrgentInput(const MIDI_event_t* event) {
+	if (event->size != 3 || event->midi_message[0] != MIDI_CC) {
+		return false;
+	}
+	switch (event->midi_message[1]) {
+		case CMD_PLAY:
+		case CMD_RESTART:
+		case CMD_REC:
+		case CMD_COUNT:
+		case CMD_STOP:
+			return true;
+	}
+	return false;
+}
+
+// A copy of the state of the tracks in a mixer bank, indexed by slot. It is
+// kept up to date by the SetSurface* callbacks, so refreshing the bank only
+// needs to query REAPER for slots which aren't valid; e.g. because they
+// contain a different track.
+struct TrackBankSnapshot {
+	// The id of the first track in the bank, or -1 if this snapshot is unused.
+	int bankStart = -1;
+	// Used to find the least recently used snapshot.
+	uint64_t lastUsed = 0;
+	array<MediaTrack*, BANK_NUM_SLOTS> track {};
+	array<bool, BANK_NUM_SLOTS> valid {};
+	array<bool, BANK_NUM_SLOTS> selected {};
+	array<bool, BANK_NUM_SLOTS> soloed {};
+	array<bool, BANK_NUM_SLOTS> muted {};
+	array<bool, BANK_NUM_SLOTS> armed {};
+	array<double, BANK_NUM_SLOTS> volume {};
+	array<double, BANK_NUM_SLOTS> pan {};
+	array<string, BANK_NUM_SLOTS> volumeText;
+	array<string, BANK_NUM_SLOTS> panText;
+	array<string, BANK_NUM_SLOTS> name;
+
+	bool isValid(int slot, MediaTrack* track) const {
+		return this->valid[slot] && this->track[slot] == track;
+	}
+
+	void invalidate() {
+		this->valid.fill(false);
+	}
+};
+
+// The text last formatted for an FX parameter shown in a slot. Formatting needs
+// a call into the plug-in, but the value often hasn't changed since the last
+// time; e.g. when REAPER reports a change to another parameter.
+struct FormattedValue {
+	// The parameter the text was formatted for.
+	MediaTrack* track = nullptr;
+	int fx = -1;
+	int param = -1;
+	double value = 0;
+	bool valid = false;
+	string text;
+
+	bool isFor(MediaTrack* track, int fx, int param, double value) const {
+		return this->valid && this->value == value && this->param == param &&
+			this->fx == fx && this->track == track;
+	}
+
+	void set(MediaTrack* track, int fx, int param, double value,
+		const char* text
+	) {
+		this->track = track;
+		this->fx = fx;
+		this->param = param;
+		this->value = value;
+		this->text = text;
+		this->valid = true;
+	}
+};
+
+// Information about an FX parameter which doesn't change while the FX is
+// loaded. Each item is fetched from REAPER the first time it is needed.
+struct FxParamInfo {
+	bool isNameKnown = false;
+	string name;
+	bool isToggleKnown = false;
+	bool isToggle = false;
+};
+
+// Tracks a knob which the user is turning, so we can avoid sending REAPER's
+// echo of the change back to the keyboard.
+struct KnobEcho {
+	bool isSuppressing = false;
+	// When we last changed the value for this knob.
+	DWORD changeTime = 0;
+	// The last position REAPER reported which we haven't sent, or -1 if none.
+	int pendingCc = -1;
+	// When we last sent the value text.
+	DWORD textTime = 0;
+	// The last value text REAPER reported which we haven't sent.
+	bool hasPendingText = false;
+	unsigned char textCommand = 0;
+	unsigned char numInBank = 0;
+	string pendingText;
+};
+
 class NiMidiSurface: public BaseSurface {
 	public:
 	NiMidiSurface(int inDev, int outDev)
-	: BaseSurface(inDev, outDev) {
+	: BaseSurface(inDev, outDev, MAX_FRAME_SIZE, isUrgentInput) {
+		const int rate = clamp(
+			getIntSetting(EXT_KEY_FX_PARAM_RATE, DEFAULT_FX_PARAM_RATE), 1, 1000);
+		this->_fxParamInterval = 1000 / rate;
+		this->_pendingFxParams.fill(-1);
 		log("sending hello");
-		this->_sendCc(CMD_HELLO, 4);
+		// This must reach the device before anything else, including messages we
+		// send immediately, such as the transport lights.
+		this->_sendCc(CMD_HELLO, 4, /* immediate */ true);
 	}
 
 	virtual ~NiMidiSurface() {
+		// Run() won't be called again, so send any queued messages now. Goodbye
+		// must be last.
+		this->_drainOutput();
 		this->_sendCc(CMD_GOODBYE, 0);
+		this->_drainOutput();
 	}
 
 	virtual const char* GetTypeString() override {
@@ -164,119 +389,195 @@ class NiMidiSurface: public BaseSurface {
 
 	virtual void SetPlayState(bool play, bool pause, bool rec) override {
 		// Update transport button lights
-		this->_sendCc(CMD_REC, rec ? 1 : 0);
+		this->_sendCc(CMD_REC, rec ? 1 : 0, /* immediate */ true);
 		if (pause) {
 			// since there is no Pause button on KK we indicate it with both Play and Stop lit
-			this->_sendCc(CMD_PLAY, 1);
-			this->_sendCc(CMD_STOP, 1);
+			this->_sendCc(CMD_PLAY, 1, /* immediate */ true);
+			this->_sendCc(CMD_STOP, 1, /* immediate */ true);
 		} else if (play) {
-			this->_sendCc(CMD_PLAY, 1);
-			this->_sendCc(CMD_STOP, 0);
+			this->_sendCc(CMD_PLAY, 1, /* immediate */ true);
+			this->_sendCc(CMD_STOP, 0, /* immediate */ true);
 		} else {
-			this->_sendCc(CMD_PLAY, 0);
-			this->_sendCc(CMD_STOP, 1);
+			this->_sendCc(CMD_PLAY, 0, /* immediate */ true);
+			this->_sendCc(CMD_STOP, 1, /* immediate */ true);
+		}
+	}
+
+	void Run() final {
+		this->_applyPendingSelection();
+		if (this->_isTrackBankDirty) {
+			this->_onTrackBankChange();
 		}
+		this->_finishDeferredWork(DEFER_BANK_REFRESH);
+		if (this->_isFxParamInfoStale) {
+			this->_pruneAllFxParamInfo();
+		}
+		const DWORD now = GetTickCount();
+		if (now - this->_lastMeterTime >= METER_INTERVAL) {
+			this->_lastMeterTime = now;
+			this->_updateMeters();
+		}
+		if (now - this->_lastFxParamTime >= this->_fxParamInterval) {
+			this->_lastFxParamTime = now;
+			this->_sendPendingFxParams();
+		}
+		this->_sendKnobEchoes(now);
+		BaseSurface::Run();
+		// Anything the user did has been handled and sent, so use the rest of this
+		// Run() to get ready for the next bank change.
+		this->_prefetchNeighbourBanks();
 	}
 
 	virtual void SetRepeatState(bool rep) override {
 		// Update repeat (aka loop) button light
-		this->_sendCc(CMD_LOOP, rep ? 1 : 0);
+		this->_sendCc(CMD_LOOP, rep ? 1 : 0, /* immediate */ true);
 	}
 
 	void SetSurfaceSelected(MediaTrack* track, bool selected) final {
-		if (!selected) {
-			return;
-		}
-		const bool wasAlreadySelected = this->_lastSelectedTrack == track;
-		this->_lastSelectedTrack = track;
-		int id = CSurf_TrackToID(track, false);
+		int id = this->_getTrackId(track);
 		int numInBank = id % BANK_NUM_SLOTS;
-		int oldBankStart = this->_trackBankStart;
-		this->_trackBankStart = id - numInBank;
-		if (this->_trackBankStart != oldBankStart) {
-			this->_onTrackBankChange();
-		} else if (wasAlreadySelected && !this->_isUsingMixerForFx()) {
-			// The track might have been renamed.
-			const char* name = (char*)GetSetMediaTrackInfo(track, "P_NAME", nullptr);
-			if (!name) {
-				name = "";
-			}
-			this->_sendSysex(CMD_TRACK_NAME, 0, numInBank, name);
+		if (TrackBankSnapshot* snap = this->_getTrackSnapshot(track, id)) {
+			snap->selected[numInBank] = selected;
 		}
-		if (!this->_isUsingMixerForFx()) {
-			this->_sendSysex(CMD_TRACK_SELECTED, 1, numInBank);
-		}
-		const string kkInstance = getKkInstanceName(track);
-		this->_sendSysex(CMD_SEL_TRACK_PARAMS_CHANGED, 0, 0, kkInstance);
-		this->_initFx();
-		if (!this->_isUsingMixerForFx()) {
-			int trackLights = 0;
-			// 0 is the master track. We don't allow navigation to that.
-			if (id > 1) {
-				// Bit 0: previous
-				trackLights |= 1;
-			}
-			// CSurf_TrackFromID treats 0 as the master, but CSurf_NumTracks doesn't
-			// count the master, so the return value is the last track, not the count.
-			if (id < CSurf_NumTracks(false)) {
-				// Bit 1: next
-				trackLights |= 1 << 1;
-			}
-			this->_sendCc(CMD_NAV_TRACKS, trackLights);
+		if (selected) {
+			// Selecting many tracks calls this for each track. Focus follow is
+			// expensive, so only do it for the last one, in Run().
+			this->_pendingSelectedTrack = track;
+			this->_deferInput(DEFER_SELECTION);
 		}
 	}
 
 	void SetTrackListChange() final {
-		// A track has been added or removed. Send updated bank info.
-		this->_onTrackBankChange();
+		// Track ids might have changed.
+		this->_trackIdsDirty = true;
+		// A track has been added or removed. A track might have been deleted and
+		// another created at the same address, so we can't trust the snapshots.
+		this->_invalidateBankSnapshots();
+		// Adding many tracks calls this for each track, so send updated bank info
+		// once in Run().
+		this->_isTrackBankDirty = true;
+		this->_deferInput(DEFER_BANK_REFRESH);
+		// Deleted tracks can't tell us their FX went away, so check for them in
+		// Run() too.
+		this->_isFxParamInfoStale = !this->_fxParamInfo.empty();
 	}
 
 	void SetSurfaceVolume(MediaTrack* track, double volume) final {
 		if (this->_isUsingMixerForFx()) {
+			// We don't keep the snapshots up to date in this mode.
+			this->_invalidateBankSnapshots();
+			return;
+		}
+		const int id = this->_getTrackId(track);
+		const int numInBank = id % BANK_NUM_SLOTS;
+		TrackBankSnapshot* snap = this->_getTrackSnapshot(track, id);
+		const bool isInBank = this->_isInTrackBank(id);
+		if (!snap && !isInBank) {
 			return;
 		}
-		const int numInBank = this->_getNumInBank(track);
-		if (numInBank != -1) {
-			char volText[64];
-			mkvolstr(volText, volume);
-			this->_sendSysex(CMD_TRACK_VOLUME_TEXT, 0, numInBank, volText);
-			this->_sendCc(CMD_KNOB_VOLUME0 + numInBank, volToCc(volume));
+		// REAPER often reports a value which hasn't changed; e.g. when another
+		// property of the track changes. The snapshot already has the text for
+		// that, so only format it when the value is new.
+		char text[64];
+		string_view volText;
+		if (snap && snap->volume[numInBank] == volume) {
+			volText = snap->volumeText[numInBank];
+		} else {
+			mkvolstr(text, volume);
+			volText = text;
+			if (snap) {
+				snap->volume[numInBank] = volume;
+				snap->volumeText[numInBank] = text;
+			}
+		}
+		if (isInBank) {
+			this->_sendKnobFeedback(CMD_KNOB_VOLUME0 + numInBank, volToCc(volume),
+				CMD_TRACK_VOLUME_TEXT, numInBank, volText);
 		}
 	}
 
 	void SetSurfacePan(MediaTrack* track, double pan) final {
 		if (this->_isUsingMixerForFx()) {
+			this->_invalidateBankSnapshots();
 			return;
 		}
-		const int numInBank = this->_getNumInBank(track);
-		if (numInBank != -1) {
-			char panText[64];
-			mkpanstr(panText, pan);
-			this->_sendSysex(CMD_TRACK_PAN_TEXT, 0, numInBank, panText);
-			this->_sendCc(CMD_KNOB_PAN0 + numInBank, panToCc(pan));
+		const int id = this->_getTrackId(track);
+		const int numInBank = id % BANK_NUM_SLOTS;
+		TrackBankSnapshot* snap = this->_getTrackSnapshot(track, id);
+		const bool isInBank = this->_isInTrackBank(id);
+		if (!snap && !isInBank) {
+			return;
+		}
+		char text[64];
+		string_view panText;
+		if (snap && snap->pan[numInBank] == pan) {
+			panText = snap->panText[numInBank];
+		} else {
+			mkpanstr(text, pan);
+			panText = text;
+			if (snap) {
+				snap->pan[numInBank] = pan;
+				snap->panText[numInBank] = text;
+			}
+		}
+		if (isInBank) {
+			this->_sendKnobFeedback(CMD_KNOB_PAN0 + numInBank, panToCc(pan),
+				CMD_TRACK_PAN_TEXT, numInBank, panText);
 		}
 	}
 
 	void SetSurfaceMute(MediaTrack *track, bool mute) final {
 		if (this->_isUsingMixerForFx()) {
+			this->_invalidateBankSnapshots();
 			return;
 		}
-		const int numInBank = this->_getNumInBank(track);
-		if (numInBank != -1) {
+		const int id = this->_getTrackId(track);
+		const int numInBank = id % BANK_NUM_SLOTS;
+		if (TrackBankSnapshot* snap = this->_getTrackSnapshot(track, id)) {
+			snap->muted[numInBank] = mute;
+		}
+		if (this->_isInTrackBank(id)) {
 			this->_sendSysex(CMD_TRACK_MUTED, mute ? 1 : 0, numInBank);
 		}
 	}
 
 	void SetSurfaceSolo(MediaTrack *track, bool solo) final {
 		if (this->_isUsingMixerForFx()) {
+			this->_invalidateBankSnapshots();
 			return;
 		}
-		const int numInBank = this->_getNumInBank(track);
-		if (numInBank != -1) {
+		const int id = this->_getTrackId(track);
+		const int numInBank = id % BANK_NUM_SLOTS;
+		if (TrackBankSnapshot* snap = this->_getTrackSnapshot(track, id)) {
+			snap->soloed[numInBank] = solo;
+		}
+		if (this->_isInTrackBank(id)) {
 			this->_sendSysex(CMD_TRACK_SOLOED, solo ? 1 : 0, numInBank);
 		}
 	}
 
+	void SetSurfaceRecArm(MediaTrack* track, bool recarm) final {
+		if (this->_isUsingMixerForFx()) {
+			this->_invalidateBankSnapshots();
+			return;
+		}
+		const int id = this->_getTrackId(track);
+		const int numInBank = id % BANK_NUM_SLOTS;
+		if (TrackBankSnapshot* snap = this->_getTrackSnapshot(track, id)) {
+			snap->armed[numInBank] = recarm;
+		}
+		if (this->_isInTrackBank(id)) {
+			this->_sendSysex(CMD_TRACK_ARMED, recarm ? 1 : 0, numInBank);
+		}
+	}
+
+	void SetTrackTitle(MediaTrack* track, const char* title) final {
+		const int id = this->_getTrackId(track);
+		if (TrackBankSnapshot* snap = this->_getTrackSnapshot(track, id)) {
+			snap->name[id % BANK_NUM_SLOTS] = title ? title : "";
+		}
+	}
+
 	int Extended(int call, void* parm1, void* parm2, void* parm3) final {
 		if (call == CSURF_EXT_SETFXPARAM) {
 			if (this->_protocolVersion < 4 && !this->_isUsingMixerForFx()) {
@@ -295,12 +596,15 @@ class NiMidiSurface: public BaseSurface {
 			if (mp < this->_fxBankStart || mp >= this->_fxBankStart + BANK_NUM_SLOTS) {
 				return 0;
 			}
-			double normVal = *(double*)parm3;
+			// Only the latest value matters, so just remember it until we next send
+			// values in Run().
 			const int numInBank = mp - this->_fxBankStart;
-			this->_fxParamValueChanged(param, numInBank, normVal);
+			this->_pendingFxParams[numInBank] = param;
+			this->_pendingFxParamValues[numInBank] = *(double*)parm3;
 		} else if (call == CSURF_EXT_SETFXCHANGE) {
 			// FX were added, removed or reordered.
 			auto track = (MediaTrack*)parm1;
+			this->_pruneFxParamInfo(track);
 			if (track == this->_lastSelectedTrack) {
 				this->_initFx();
 			}
@@ -317,7 +621,8 @@ class NiMidiSurface: public BaseSurface {
 			for (int b = 0; b < 5; ++b) {
 				data[b] = (kTempo >> (b * 7)) & 0x7F;
 			}
-			this->_sendSysex(CMD_SET_TEMPO, 0, 0, string((char*)data, sizeof(data)));
+			this->_sendSysex(CMD_SET_TEMPO, 0, 0,
+				string_view((char*)data, sizeof(data)));
 		}
 		return 0;
 	}
@@ -325,252 +630,82 @@ class NiMidiSurface: public BaseSurface {
 	protected:
 	void _onMidiEvent(MIDI_event_t* event) override {
 		if (event->midi_message[0] == MIDI_SYSEX_BEGIN[0]) {
-			const unsigned char* data = event->midi_message + sizeof(MIDI_SYSEX_BEGIN);
-			const unsigned char command = *data;
-			++data;
-			const unsigned char value = *data;
-			++data;
-			const unsigned char index = *data;
-			++data;
-			// infoSize is the number of bytes of additional info. We subtract the
-			// sysex prefix, plus 3 bytes for the command, value and index, plus an
-			// additional byte for the sysex suffix.
-			int infoSize = event->size - sizeof(MIDI_SYSEX_BEGIN) - 4;
-			switch (command) {
-				case CMD_SET_TEMPO: {
-					// The value is an integer serialised as 5 7-bit values in little
-					// endian order.
-					int kTempo = 0;
-					for (size_t b = 0; b < 5; ++b) {
-						kTempo += data[b] << (b * 7);
-					}
-					// The integer represents the duration of a quarter note in multiples of
-					// 10ns.
-					const double bpm = 60 / (kTempo * TEN_NS_IN_SEC);
-					CSurf_OnTempoChange(bpm);
-					break;
-				}
-				case CMD_SELECT_PLUGIN:
-					this->_selectFx(index, data, infoSize);
-					break;
-				case CMD_PARAM_HIGH_RES:
-					// For protocol version 4 (S MK3), we receive this instead of
-					// CMD_KNOB_* CC messages.
-					this->_changeParamHighRes(value, index, data[0], data[1]);
-					break;
-				default:
-					log("Unhandled MIDI sysex command " << showbase << hex
-						<< (int)command << " " << (int)value << " " << (int)index);
-					break;
+			SysexFrame frame;
+			if (event->size < 0 || !parseSysex({event->midi_message,
+					(size_t)event->size}, frame)) {
+				log("Malformed MIDI sysex message of size " << event->size);
+				return;
+			}
+			if (frame.command != CMD_PARAM_HIGH_RES) {
+				this->_applyPendingDeltas();
+				// The command might depend on the selected track.
+				this->_applyPendingSelection();
+			}
+			const SysexHandler handler = SYSEX_DISPATCH[frame.command & 0x7F].handler;
+			if (!handler) {
+				log("Unhandled MIDI sysex command " << showbase << hex
+					<< (int)frame.command << " " << (int)frame.value << " "
+					<< (int)frame.index);
+				return;
 			}
+			(this->*handler)(frame.value, frame.index, frame.info);
 			return;
 		}
 
 		if (event->midi_message[0] != MIDI_CC) {
 			return;
 		}
-		unsigned char& command = event->midi_message[1];
-		unsigned char& value = event->midi_message[2];
-		switch (command) {
-			case CMD_HELLO:
-				this->_protocolVersion = value;
-				log("received hello ack, protocol version " << this->_protocolVersion);
-				this->_sendCc(CMD_QUANTIZE, 1);
-				this->_sendCc(CMD_TEMPO, 1);
-				// Strictly speaking, we should only set bit 0 when we're not at the
-				// start of the project, and bit 1 when we're not at the end of the
-				// project/time selection/loop area. However, this would involve polling
-				// the cursor position, which isn't ideal. For now, just always enable
-				// both previous and next.
-				this->_sendCc(CMD_NAV_CLIPS, 3);
-				// Specify vertical track navigation.
-				this->_sendSysex(CMD_SURFACE_CONFIG, 1, 0, "track_orientation");
-				this->_onTrackBankChange();
-				if (this->_protocolVersion >= 4) {
-					// For S MK3, request sysex high resolution parameter adjustments.
-					this->_sendCc(CMD_USE_SYSEX_PARAM, 1);
-				}
-				break;
-			case CMD_BANK_MAPPING:
-				this->_isBankNavForTracks = value == 0;
-				break;
-			case CMD_PLAY:
-				// Toggles between play and pause
-				CSurf_OnPlay();
-				break;
-			case CMD_RESTART:
-				CSurf_GoStart();
-				if (GetPlayState() & ~1) {
-					// Only play if current state is not playing
-					CSurf_OnPlay();
-				}
-				break;
-			case CMD_REC:
-				CSurf_OnRecord();
-				break;
-			case CMD_COUNT:
-				this->_toggleCountIn();
-				break;
-			case CMD_STOP:
-				CSurf_OnStop();
-				break;
-			case CMD_PLAY_CLIP:
-				if (this->_protocolVersion < 4) {
-					// Toggle the mode where we use the mixer for FX parameters. See
-					// _isUsingMixerForFx.
-					this->_isBankNavForTracks = !this->_isBankNavForTracks;
-					if (this->_isBankNavForTracks) {
-						if (osara_outputMessage) {
-							osara_outputMessage("tracks");
-						}
-						this->_onTrackBankChange();
-					} else {
-						if (osara_outputMessage) {
-							osara_outputMessage("FX");
-						}
-						this->_fxBankChanged(/* shouldOutputOsaraMessage */ false);
-					}
-				}
-				break;
-			case CMD_LOOP:
-				Main_OnCommand(1068, 0); // Transport: Toggle repeat
-				break;
-			case CMD_METRO:
-				Main_OnCommand(40364, 0); // Options: Toggle metronome
-				break;
-			case CMD_TEMPO:
-				Main_OnCommand(1134, 0); // Transport: Tap tempo
-				break;
-			case CMD_UNDO:
-				Main_OnCommand(40029, 0); // Edit: Undo
-				break;
-			case CMD_REDO:
-				Main_OnCommand(40030, 0); // Edit: Redo
-				break;
-			case CMD_QUANTIZE:
-				Main_OnCommand(42033, 0); // Track: Toggle MIDI input quantize for selected tracks
-				break;
-			case CMD_NAV_TRACKS:
-				// Value is -1 or 1.
-				if (this->_isUsingMixerForFx()) {
-					this->_navigateFx(value == 1);
-					break;
-				}
-				this->_onNavigateTracks(value == 1);
-				break;
-			case CMD_NAV_BANKS:
-				// Value is -1 or 1.
-				if (this->_isBankNavForTracks) {
-					this->_onTrackBankSelect(convertSignedMidiValue(value));
-				} else {
-					this->_navigateFxBanks(value == 1);
-				}
-				break;
-			case CMD_NAV_CLIPS:
-				// Value is -1 or 1.
-				if (this->_isUsingMixerForFx()) {
-					this->_navigateFxBanks(value == 1);
-					break;
-				}
-				Main_OnCommand(value == 1 ?
-					40173 : // Markers: Go to next marker/project end
-					40172, // Markers: Go to previous marker/project start
-				0);
-				break;
-			case CMD_MOVE_TRANSPORT:
-				// Value is -1 or 1.
-				Main_OnCommand(value == 1 ?
-					40647 : // View: Move cursor right to grid division
-					40646, // View: Move cursor left to grid division
-				0);
-				break;
-			case CMD_NAV_PRESET:
-				TrackFX_NavigatePresets(this->_lastSelectedTrack, this->_selectedFx,
-					convertSignedMidiValue(value));
-				this->_fxPresetChanged();
-				break;
-			case CMD_TRACK_SELECTED:
-				// Select a track from current bank in Mixer Mode with top row buttons
-				if (MediaTrack* track = this->_getTrackFromNumInBank(value)) {
-					SetOnlyTrackSelected(track);
-				}
-				break;
-			case CMD_TRACK_MUTED:
-				if (MediaTrack* track = this->_getTrackFromNumInBank(value)) {
-					CSurf_SetSurfaceMute(track, CSurf_OnMuteChange(track, -1), nullptr);
-				}
-				break;
-			case CMD_TRACK_SOLOED:
-				if (MediaTrack* track = this->_getTrackFromNumInBank(value)) {
-					CSurf_SetSurfaceSolo(track, CSurf_OnSoloChange(track, -1), nullptr);
-				}
-				break;
-			case CMD_KNOB_VOLUME0:
-			case CMD_KNOB_VOLUME1:
-			case CMD_KNOB_VOLUME2:
-			case CMD_KNOB_VOLUME3:
-			case CMD_KNOB_VOLUME4:
-			case CMD_KNOB_VOLUME5:
-			case CMD_KNOB_VOLUME6:
-			case CMD_KNOB_VOLUME7: {
-				const int numInBank = command - CMD_KNOB_VOLUME0;
-				if (this->_isUsingMixerForFx()) {
-					this->_changeFxParamValue(numInBank, convertSignedMidiValue(value) / 127.0
-						/ 8.0);
-					break;
-				}
-				if (MediaTrack* track = this->_getTrackFromNumInBank(numInBank)) {
-					CSurf_SetSurfaceVolume(track, CSurf_OnVolumeChange(track,
-						convertSignedMidiValue(value) / 127.0, true), nullptr);
-				}
-				break;
-			}
-			case CMD_KNOB_PAN0:
-			case CMD_KNOB_PAN1:
-			case CMD_KNOB_PAN2:
-			case CMD_KNOB_PAN3:
-			case CMD_KNOB_PAN4:
-			case CMD_KNOB_PAN5:
-			case CMD_KNOB_PAN6:
-			case CMD_KNOB_PAN7:
-				if (MediaTrack* track = this->_getTrackFromNumInBank(command - CMD_KNOB_PAN0)) {
-					CSurf_SetSurfacePan(track, CSurf_OnPanChange(track,
-						convertSignedMidiValue(value) / CC_PAN_SCALE_FACTOR, true), nullptr);
-				}
-				break;
-			case CMD_CHANGE_VOLUME:
-				CSurf_SetSurfaceVolume(this->_lastSelectedTrack,
-					CSurf_OnVolumeChange(this->_lastSelectedTrack,
-						convertSignedMidiValue(value) / 127.0, true),
-					nullptr);
-				break;
-			case CMD_CHANGE_PAN:
-				CSurf_SetSurfacePan(this->_lastSelectedTrack,
-					CSurf_OnPanChange(this->_lastSelectedTrack,
-						convertSignedMidiValue(value) / CC_PAN_SCALE_FACTOR, true),
-					nullptr);
-				break;
-			case CMD_TOGGLE_MUTE:
-				CSurf_SetSurfaceMute(this->_lastSelectedTrack,
-					CSurf_OnMuteChange(this->_lastSelectedTrack, -1), nullptr);
-				break;
-			case CMD_TOGGLE_SOLO:
-				CSurf_SetSurfaceSolo(this->_lastSelectedTrack,
-					CSurf_OnSoloChange(this->_lastSelectedTrack, -1), nullptr);
-				break;
-			default:
-				log("Unhandled MIDI message " << showbase << hex
-					<< (int)event->midi_message[0] << " "
-					<< (int)event->midi_message[1] << " "
-					<< (int)event->midi_message[2]);
-				break;
+		const unsigned char command = event->midi_message[1] & 0x7F;
+		const unsigned char value = event->midi_message[2];
+		if (CC_DELTA_DISPATCH[command].handler) {
+			// When a knob is turned quickly, we get many of these in one Run(). We add
+			// them up and apply them together in _onMidiEventsDone.
+			this->_pendingDeltas[command] += convertSignedMidiValue(value);
+			this->_hasPendingDeltas = true;
+			this->_deferInput(DEFER_KNOBS);
+			return;
 		}
+		// Other commands might change what the deltas apply to; e.g. switching
+		// banks. Apply the deltas received so far first.
+		this->_applyPendingDeltas();
+		// Other commands might depend on the selected track; e.g. navigating
+		// tracks moves relative to it.
+		this->_applyPendingSelection();
+		const DispatchEntry<CcHandler>& entry = CC_DISPATCH[command];
+		if (!entry.handler) {
+			log("Unhandled MIDI message " << showbase << hex
+				<< (int)event->midi_message[0] << " "
+				<< (int)event->midi_message[1] << " "
+				<< (int)event->midi_message[2]);
+			return;
+		}
+		(this->*entry.handler)(entry.slot, value);
+	}
+
+	void _onMidiEventsDone() override {
+		this->_applyPendingDeltas();
+		// If the user selected a track from the device, show it before we send.
+		this->_applyPendingSelection();
+	}
+
+	uint16_t _getInputStatsKey(const MIDI_event_t* event) override {
+		SysexFrame frame;
+		if (event->midi_message[0] == MIDI_SYSEX_BEGIN[0] && event->size > 0 &&
+				parseSysex({event->midi_message, (size_t)event->size}, frame)) {
+			// The command follows the sysex prefix.
+			return MIDI_SYSEX_BEGIN[0] << 8 | frame.command;
+		}
+		return BaseSurface::_getInputStatsKey(event);
 	}
 
 	private:
 	int _protocolVersion = 0;
 	int _trackBankStart = 0;
+	// Whether the track list changed since we last sent the bank.
+	bool _isTrackBankDirty = false;
 	MediaTrack* _lastSelectedTrack = nullptr;
+	// The last track REAPER told us was selected since the last Run().
+	MediaTrack* _pendingSelectedTrack = nullptr;
 	// If true, bank navigation messages are for tracks. If false, they are for
 	// plugin parameters.
 	bool _isBankNavForTracks = true;
@@ -582,8 +717,384 @@ class NiMidiSurface: public BaseSurface {
 	int _suppressFxParam = -1;
 	DWORD _suppressFxParamStartTime = 0;
 	string _lastFxParamValueOsara;
+	// The level shown by each meter, with left and right for each slot, and how
+	// many more updates its peak will be held for.
+	array<unsigned char, BANK_NUM_SLOTS * 2> _meterLevels {};
+	array<unsigned char, BANK_NUM_SLOTS * 2> _meterHolds {};
+	DWORD _lastMeterTime = 0;
+	// Maps tracks to their ids. REAPER calls the SetSurface* callbacks for every
+	// track, and CSurf_TrackToID searches all tracks, which is slow in large
+	// projects. This is rebuilt when it is next used after the track list
+	// changes.
+	unordered_map<MediaTrack*, int> _trackIds;
+	bool _trackIdsDirty = true;
+	// Snapshots of recently used banks.
+	array<TrackBankSnapshot, 3> _bankSnapshots;
+	uint64_t _bankSnapshotUseCount = 0;
+	// The FX parameter text last formatted for each slot. Track volume and pan
+	// text is kept in the bank snapshots.
+	array<FormattedValue, BANK_NUM_SLOTS> _paramTexts;
+	// FX parameter changes reported by REAPER which we haven't sent yet, indexed
+	// by slot. The parameter is -1 if there is nothing to send for a slot.
+	array<int, BANK_NUM_SLOTS> _pendingFxParams;
+	array<double, BANK_NUM_SLOTS> _pendingFxParamValues {};
+	DWORD _fxParamInterval = 0;
+	DWORD _lastFxParamTime = 0;
+	// Indexed by knob CC command.
+	array<KnobEcho, 128> _knobEchoes;
+	// Parameter info for FX we've shown, keyed by track and FX GUID, then indexed
+	// by REAPER parameter. Some plug-ins have thousands of parameters and
+	// querying them can be slow, especially if they're bridged, so this is
+	// filled as pages are shown rather than all at once.
+	map<pair<MediaTrack*, string>, vector<FxParamInfo>> _fxParamInfo;
+	// The entry in _fxParamInfo for the selected FX.
+	vector<FxParamInfo>* _selectedFxParamInfo = nullptr;
+	// Whether _fxParamInfo might have entries for deleted tracks.
+	bool _isFxParamInfoStale = false;
+
+	// Handlers for CC commands. slot is the position of the command within a
+	// range of commands, such as CMD_KNOB_VOLUME0 to CMD_KNOB_VOLUME7. It is 0
+	// for commands which aren't part of a range.
+	using CcHandler = void (NiMidiSurface::*)(unsigned char slot,
+		unsigned char value);
+	static const DispatchTable<CcHandler> CC_DISPATCH;
+	// Handlers for sysex commands. info is the bytes after the index, excluding
+	// the sysex suffix.
+	using SysexHandler = void (NiMidiSurface::*)(unsigned char value,
+		unsigned char index, span<const unsigned char> info);
+	static const DispatchTable<SysexHandler> SYSEX_DISPATCH;
+	// Handlers for CC commands which carry a relative change, such as knob turns.
+	// delta is the sum of the changes received for the command in a Run().
+	using CcDeltaHandler = void (NiMidiSurface::*)(unsigned char slot,
+		int delta);
+	static const DispatchTable<CcDeltaHandler> CC_DELTA_DISPATCH;
+	friend constexpr DispatchTable<CcHandler> makeCcDispatch();
+	friend constexpr DispatchTable<SysexHandler> makeSysexDispatch();
+	friend constexpr DispatchTable<CcDeltaHandler> makeCcDeltaDispatch();
+	// The sum of the changes received for each delta command which haven't been
+	// applied yet, indexed by command.
+	array<int, 128> _pendingDeltas {};
+	// Likewise for CMD_PARAM_HIGH_RES, indexed by parameter group and slot. These
+	// are in raw 14 bit steps.
+	int _pendingHighResDeltas[PARAM_GROUP_PLUGIN + 1][BANK_NUM_SLOTS] {};
+	bool _hasPendingDeltas = false;
+
+	void _applyPendingDeltas() {
+		if (!this->_hasPendingDeltas) {
+			return;
+		}
+		this->_hasPendingDeltas = false;
+		// Some deltas apply to the selected track.
+		this->_applyPendingSelection();
+		for (unsigned char command = 0; command < 128; ++command) {
+			int& delta = this->_pendingDeltas[command];
+			if (delta == 0) {
+				continue;
+			}
+			const DispatchEntry<CcDeltaHandler>& entry = CC_DELTA_DISPATCH[command];
+			(this->*entry.handler)(entry.slot, delta);
+			delta = 0;
+		}
+		for (unsigned char group = 0; group <= PARAM_GROUP_PLUGIN; ++group) {
+			for (unsigned char index = 0; index < BANK_NUM_SLOTS; ++index) {
+				int& delta = this->_pendingHighResDeltas[group][index];
+				if (delta == 0) {
+					continue;
+				}
+				this->_changeParamHighRes(group, index, delta / 8191.0);
+				delta = 0;
+			}
+		}
+		this->_finishDeferredWork(DEFER_KNOBS);
+	}
+
+	void _onSetTempo(unsigned char value, unsigned char index,
+		span<const unsigned char> info
+	) {
+		// The value is an integer serialised as 5 7-bit values in little
+		// endian order.
+		if (info.size() < 5) {
+			return;
+		}
+		// 5 7-bit values make 35 bits, which doesn't fit in an int. Sysex data
+		// bytes should only use 7 bits, but a bad message might set the top bit.
+		int64_t kTempo = 0;
+		for (size_t b = 0; b < 5; ++b) {
+			kTempo |= int64_t(info[b] & 0x7F) << (b * 7);
+		}
+		if (kTempo == 0) {
+			return;
+		}
+		// The integer represents the duration of a quarter note in multiples of
+		// 10ns.
+		const double bpm = 60 / (kTempo * TEN_NS_IN_SEC);
+		CSurf_OnTempoChange(bpm);
+	}
+
+	void _onSelectPlugin(unsigned char value, unsigned char index,
+		span<const unsigned char> info
+	) {
+		this->_selectFx(index, info.data(), info.size());
+	}
+
+	void _onParamHighRes(unsigned char value, unsigned char index,
+		span<const unsigned char> info
+	) {
+		// For protocol version 4 (S MK3), we receive this instead of
+		// CMD_KNOB_* CC messages.
+		if (value > PARAM_GROUP_PLUGIN || index >= BANK_NUM_SLOTS ||
+				info.size() < 2) {
+			return;
+		}
+		int delta = info[0] + (info[1] << 7);
+		if (delta > 8192) {
+			// Convert to signed value.
+			delta -= 16384;
+		}
+		// Changing a plugin parameter can be expensive, so we add these up and
+		// apply them together in _onMidiEventsDone.
+		this->_pendingHighResDeltas[value][index] += delta;
+		this->_hasPendingDeltas = true;
+		this->_deferInput(DEFER_KNOBS);
+	}
+
+	void _onHello(unsigned char slot, unsigned char value) {
+		this->_protocolVersion = value;
+		log("received hello ack, protocol version " << this->_protocolVersion);
+		// The device has (re)started, so it doesn't show anything we sent before.
+		this->_resetDeviceState();
+		this->_sendCc(CMD_QUANTIZE, 1);
+		this->_sendCc(CMD_TEMPO, 1);
+		// Strictly speaking, we should only set bit 0 when we're not at the
+		// start of the project, and bit 1 when we're not at the end of the
+		// project/time selection/loop area. However, this would involve polling
+		// the cursor position, which isn't ideal. For now, just always enable
+		// both previous and next.
+		this->_sendCc(CMD_NAV_CLIPS, 3);
+		// Specify vertical track navigation.
+		this->_sendSysex(CMD_SURFACE_CONFIG, 1, 0, "track_orientation");
+		this->_onTrackBankChange();
+		if (this->_protocolVersion >= 4) {
+			// For S MK3, request sysex high resolution parameter adjustments.
+			this->_sendCc(CMD_USE_SYSEX_PARAM, 1);
+		}
+	}
+
+	void _onBankMapping(unsigned char slot, unsigned char value) {
+		this->_isBankNavForTracks = value == 0;
+	}
+
+	void _onPlay(unsigned char slot, unsigned char value) {
+		// Toggles between play and pause
+		CSurf_OnPlay();
+	}
+
+	void _onRestart(unsigned char slot, unsigned char value) {
+		CSurf_GoStart();
+		if (GetPlayState() & ~1) {
+			// Only play if current state is not playing
+			CSurf_OnPlay();
+		}
+	}
+
+	void _onRec(unsigned char slot, unsigned char value) {
+		CSurf_OnRecord();
+	}
+
+	void _onCount(unsigned char slot, unsigned char value) {
+		this->_toggleCountIn();
+	}
+
+	void _onStop(unsigned char slot, unsigned char value) {
+		CSurf_OnStop();
+	}
+
+	void _onPlayClip(unsigned char slot, unsigned char value) {
+		if (this->_protocolVersion >= 4) {
+			return;
+		}
+		// Toggle the mode where we use the mixer for FX parameters. See
+		// _isUsingMixerForFx.
+		this->_isBankNavForTracks = !this->_isBankNavForTracks;
+		if (this->_isBankNavForTracks) {
+			if (osara_outputMessage) {
+				osara_outputMessage("tracks");
+			}
+			this->_onTrackBankChange();
+		} else {
+			if (osara_outputMessage) {
+				osara_outputMessage("FX");
+			}
+			this->_fxBankChanged(/* shouldOutputOsaraMessage */ false);
+		}
+	}
+
+	// Handles commands which simply run a REAPER action.
+	template<int action>
+	void _runAction(unsigned char slot, unsigned char value) {
+		Main_OnCommand(action, 0);
+	}
+
+	void _onNavTracks(unsigned char slot, unsigned char value) {
+		// Value is -1 or 1.
+		if (this->_isUsingMixerForFx()) {
+			this->_navigateFx(value == 1);
+			return;
+		}
+		this->_onNavigateTracks(value == 1);
+	}
+
+	void _onNavBanks(unsigned char slot, unsigned char value) {
+		// Value is -1 or 1.
+		if (this->_isBankNavForTracks) {
+			this->_onTrackBankSelect(convertSignedMidiValue(value));
+		} else {
+			this->_navigateFxBanks(value == 1);
+		}
+	}
+
+	void _onNavClips(unsigned char slot, unsigned char value) {
+		// Value is -1 or 1.
+		if (this->_isUsingMixerForFx()) {
+			this->_navigateFxBanks(value == 1);
+			return;
+		}
+		Main_OnCommand(value == 1 ?
+			40173 : // Markers: Go to next marker/project end
+			40172, // Markers: Go to previous marker/project start
+		0);
+	}
+
+	void _onMoveTransport(unsigned char slot, unsigned char value) {
+		// Value is -1 or 1.
+		Main_OnCommand(value == 1 ?
+			40647 : // View: Move cursor right to grid division
+			40646, // View: Move cursor left to grid division
+		0);
+	}
+
+	void _onNavPreset(unsigned char slot, unsigned char value) {
+		TrackFX_NavigatePresets(this->_lastSelectedTrack, this->_selectedFx,
+			convertSignedMidiValue(value));
+		this->_fxPresetChanged();
+	}
+
+	void _onTrackSelected(unsigned char slot, unsigned char value) {
+		// Select a track from current bank in Mixer Mode with top row buttons
+		if (MediaTrack* track = this->_getTrackFromNumInBank(value)) {
+			SetOnlyTrackSelected(track);
+		}
+	}
+
+	void _onTrackMuted(unsigned char slot, unsigned char value) {
+		if (MediaTrack* track = this->_getTrackFromNumInBank(value)) {
+			CSurf_SetSurfaceMute(track, CSurf_OnMuteChange(track, -1), nullptr);
+		}
+	}
+
+	void _onTrackSoloed(unsigned char slot, unsigned char value) {
+		if (MediaTrack* track = this->_getTrackFromNumInBank(value)) {
+			CSurf_SetSurfaceSolo(track, CSurf_OnSoloChange(track, -1), nullptr);
+		}
+	}
+
+	void _onKnobVolume(unsigned char numInBank, int delta) {
+		if (this->_isUsingMixerForFx()) {
+			this->_changeFxParamValue(numInBank, delta / 127.0 / 8.0);
+			return;
+		}
+		if (MediaTrack* track = this->_getTrackFromNumInBank(numInBank)) {
+			this->_onKnobChanged(CMD_KNOB_VOLUME0 + numInBank);
+			CSurf_SetSurfaceVolume(track, CSurf_OnVolumeChange(track,
+				delta / 127.0, true), nullptr);
+		}
+	}
+
+	void _onKnobPan(unsigned char numInBank, int delta) {
+		if (MediaTrack* track = this->_getTrackFromNumInBank(numInBank)) {
+			this->_onKnobChanged(CMD_KNOB_PAN0 + numInBank);
+			CSurf_SetSurfacePan(track, CSurf_OnPanChange(track,
+				delta / CC_PAN_SCALE_FACTOR, true), nullptr);
+		}
+	}
+
+	void _onChangeVolume(unsigned char slot, int delta) {
+		CSurf_SetSurfaceVolume(this->_lastSelectedTrack,
+			CSurf_OnVolumeChange(this->_lastSelectedTrack, delta / 127.0, true),
+			nullptr);
+	}
+
+	void _onChangePan(unsigned char slot, int delta) {
+		CSurf_SetSurfacePan(this->_lastSelectedTrack,
+			CSurf_OnPanChange(this->_lastSelectedTrack,
+				delta / CC_PAN_SCALE_FACTOR, true),
+			nullptr);
+	}
+
+	void _onToggleMute(unsigned char slot, unsigned char value) {
+		CSurf_SetSurfaceMute(this->_lastSelectedTrack,
+			CSurf_OnMuteChange(this->_lastSelectedTrack, -1), nullptr);
+	}
+
+	void _onToggleSolo(unsigned char slot, unsigned char value) {
+		CSurf_SetSurfaceSolo(this->_lastSelectedTrack,
+			CSurf_OnSoloChange(this->_lastSelectedTrack, -1), nullptr);
+	}
+
+	void _applyPendingSelection() {
+		if (MediaTrack* track = this->_pendingSelectedTrack) {
+			this->_pendingSelectedTrack = nullptr;
+			this->_onSurfaceSelected(track);
+			this->_finishDeferredWork(DEFER_SELECTION);
+		}
+	}
+
+	void _onSurfaceSelected(MediaTrack* track) {
+		int id = this->_getTrackId(track);
+		if (id < 0) {
+			// The track was removed before we got to it.
+			return;
+		}
+		int numInBank = id % BANK_NUM_SLOTS;
+		const bool wasAlreadySelected = this->_lastSelectedTrack == track;
+		this->_lastSelectedTrack = track;
+		int oldBankStart = this->_trackBankStart;
+		this->_trackBankStart = id - numInBank;
+		if (this->_trackBankStart != oldBankStart) {
+			this->_onTrackBankChange();
+		} else if (wasAlreadySelected && !this->_isUsingMixerForFx()) {
+			// The track might have been renamed.
+			const char* name = (char*)GetSetMediaTrackInfo(track, "P_NAME", nullptr);
+			if (!name) {
+				name = "";
+			}
+			this->_sendSysex(CMD_TRACK_NAME, 0, numInBank, name);
+		}
+		if (!this->_isUsingMixerForFx()) {
+			this->_sendSysex(CMD_TRACK_SELECTED, 1, numInBank);
+		}
+		const string kkInstance = getKkInstanceName(track);
+		this->_sendSysex(CMD_SEL_TRACK_PARAMS_CHANGED, 0, 0, kkInstance);
+		this->_initFx();
+		if (!this->_isUsingMixerForFx()) {
+			int trackLights = 0;
+			// 0 is the master track. We don't allow navigation to that.
+			if (id > 1) {
+				// Bit 0: previous
+				trackLights |= 1;
+			}
+			// CSurf_TrackFromID treats 0 as the master, but CSurf_NumTracks doesn't
+			// count the master, so the return value is the last track, not the count.
+			if (id < CSurf_NumTracks(false)) {
+				// Bit 1: next
+				trackLights |= 1 << 1;
+			}
+			this->_sendCc(CMD_NAV_TRACKS, trackLights);
+		}
+	}
 
 	void _onTrackBankChange() {
+		this->_isTrackBankDirty = false;
 		if (this->_isUsingMixerForFx()) {
 			return;
 		}
@@ -601,37 +1112,46 @@ class NiMidiSurface: public BaseSurface {
 				this->_sendSysex(CMD_TRACK_AVAIL, 0, i);
 			}
 		}
+		this->_resetKnobEchoes();
+		TrackBankSnapshot& snap = this->_getBankSnapshot(this->_trackBankStart);
 		for (int id = this->_trackBankStart; id < bankEnd; ++id, ++numInBank) {
 			MediaTrack* track = CSurf_TrackFromID(id, false);
 			if (!track) {
 				break;
 			}
-			this->_sendSysex(CMD_TRACK_AVAIL, TRTYPE_UNSPEC, numInBank);
-			int selected = *(int*)GetSetMediaTrackInfo(track, "I_SELECTED", nullptr);
-			this->_sendSysex(CMD_TRACK_SELECTED, selected, numInBank);
-			int soloState = *(int*)GetSetMediaTrackInfo(track, "I_SOLO", nullptr);
-			this->_sendSysex(CMD_TRACK_SOLOED, (soloState==0) ? 0 : 1, numInBank);
-			bool muted = *(bool*)GetSetMediaTrackInfo(track, "B_MUTE", nullptr);
-			this->_sendSysex(CMD_TRACK_MUTED, muted ? 1 : 0, numInBank);
-			int armed = *(int*)GetSetMediaTrackInfo(track, "I_RECARM", nullptr);
-			this->_sendSysex(CMD_TRACK_ARMED, armed, numInBank);
-			double volume = *(double*)GetSetMediaTrackInfo(track, "D_VOL", nullptr);
-			char volText[64];
-			mkvolstr(volText, volume);
-			this->_sendSysex(CMD_TRACK_VOLUME_TEXT, 0, numInBank, volText);
-			double pan = *(double*)GetSetMediaTrackInfo(track, "D_PAN", nullptr);
-			char panText[64];
-			mkpanstr(panText, pan);
-			this->_sendSysex(CMD_TRACK_PAN_TEXT, 0, numInBank, panText);
-			const char* name = (char*)GetSetMediaTrackInfo(track, "P_NAME", nullptr);
-			if (!name) {
-				name = "";
+			if (!snap.isValid(numInBank, track)) {
+				this->_updateBankSnapshot(snap, numInBank, track);
 			}
-			this->_sendSysex(CMD_TRACK_NAME, 0, numInBank, name);
-			// todo: level meters
-			this->_sendCc(CMD_KNOB_VOLUME0 + numInBank, volToCc(volume));
-			this->_sendCc(CMD_KNOB_PAN0 + numInBank, panToCc(pan));
+			this->_sendSysex(CMD_TRACK_AVAIL, TRTYPE_UNSPEC, numInBank);
+			this->_sendSysex(CMD_TRACK_SELECTED, snap.selected[numInBank] ? 1 : 0,
+				numInBank);
+			this->_sendSysex(CMD_TRACK_SOLOED, snap.soloed[numInBank] ? 1 : 0,
+				numInBank);
+			this->_sendSysex(CMD_TRACK_MUTED, snap.muted[numInBank] ? 1 : 0,
+				numInBank);
+			this->_sendSysex(CMD_TRACK_ARMED, snap.armed[numInBank] ? 1 : 0,
+				numInBank);
+			this->_sendSysex(CMD_TRACK_VOLUME_TEXT, 0, numInBank,
+				snap.volumeText[numInBank]);
+			this->_sendSysex(CMD_TRACK_PAN_TEXT, 0, numInBank,
+				snap.panText[numInBank]);
+			this->_sendSysex(CMD_TRACK_NAME, 0, numInBank, snap.name[numInBank]);
+		}
+		const int numAvailable = numInBank;
+		for (; numInBank < BANK_NUM_SLOTS; ++numInBank) {
+			snap.valid[numInBank] = false;
 		}
+		array<unsigned char, BANK_NUM_SLOTS> volumeCcs;
+		volsToCcs(getVolCcThresholds(), snap.volume, volumeCcs);
+		array<unsigned char, BANK_NUM_SLOTS> panCcs;
+		pansToCcs(snap.pan, panCcs);
+		for (numInBank = 0; numInBank < numAvailable; ++numInBank) {
+			this->_sendCc(CMD_KNOB_VOLUME0 + numInBank, volumeCcs[numInBank]);
+			this->_sendCc(CMD_KNOB_PAN0 + numInBank, panCcs[numInBank]);
+		}
+		// The meters now show different tracks, so don't hold the old peaks.
+		this->_meterLevels.fill(0);
+		this->_meterHolds.fill(0);
 		int bankLights = 0;
 		if (this->_trackBankStart > 0) {
 			// Bit 0: previous
@@ -644,6 +1164,145 @@ class NiMidiSurface: public BaseSurface {
 		this->_sendCc(CMD_NAV_BANKS, bankLights);
 	}
 
+	void _updateMeters() {
+		if (this->_protocolVersion == 0 || this->_isUsingMixerForFx()) {
+			return;
+		}
+		unsigned char levels[BANK_NUM_SLOTS * 2];
+		size_t numLevels = 0;
+		for (int numInBank = 0; numInBank < BANK_NUM_SLOTS; ++numInBank) {
+			MediaTrack* track = CSurf_TrackFromID(
+				this->_trackBankStart + numInBank, false);
+			if (!track) {
+				break;
+			}
+			for (int channel = 0; channel < 2; ++channel, ++numLevels) {
+				const unsigned char peak = peakToMeter(Track_GetPeakInfo(track, channel));
+				unsigned char& level = this->_meterLevels[numLevels];
+				unsigned char& hold = this->_meterHolds[numLevels];
+				if (peak >= level) {
+					level = peak;
+					hold = METER_HOLD_UPDATES;
+				} else if (hold > 0) {
+					--hold;
+				} else {
+					level = max(peak, (unsigned char)max(level - METER_DECAY_STEP, 1));
+				}
+				levels[numLevels] = level;
+			}
+		}
+		if (numLevels == 0) {
+			return;
+		}
+		// All the meters in the bank are sent in a single message. If none of them
+		// changed, _sendFrame drops it.
+		this->_sendSysex(CMD_TRACK_VU, 2, 0,
+			string_view((char*)levels, numLevels));
+	}
+
+	// Get the snapshot for a bank, reusing the least recently used snapshot if
+	// there isn't one.
+	TrackBankSnapshot& _getBankSnapshot(int bankStart) {
+		TrackBankSnapshot* found = &this->_bankSnapshots[0];
+		for (TrackBankSnapshot& snap : this->_bankSnapshots) {
+			if (snap.bankStart == bankStart) {
+				found = &snap;
+				break;
+			}
+			if (snap.lastUsed < found->lastUsed) {
+				found = &snap;
+			}
+		}
+		if (found->bankStart != bankStart) {
+			found->bankStart = bankStart;
+			found->invalidate();
+		}
+		found->lastUsed = ++this->_bankSnapshotUseCount;
+		return *found;
+	}
+
+	// Returns the snapshot containing a track with the given id if it is valid.
+	TrackBankSnapshot* _getTrackSnapshot(MediaTrack* track, int id) {
+		const int numInBank = id % BANK_NUM_SLOTS;
+		for (TrackBankSnapshot& snap : this->_bankSnapshots) {
+			if (snap.bankStart == id - numInBank) {
+				return snap.isValid(numInBank, track) ? &snap : nullptr;
+			}
+		}
+		return nullptr;
+	}
+
+	void _invalidateBankSnapshots() {
+		for (TrackBankSnapshot& snap : this->_bankSnapshots) {
+			snap.invalidate();
+		}
+	}
+
+	// Fill the snapshots for the banks either side of the current one, so that
+	// paging to them only needs to send what we already have. The snapshots are
+	// kept up to date by the SetSurface* callbacks once they're filled.
+	void _prefetchNeighbourBanks() {
+		if (this->_protocolVersion == 0 || this->_isUsingMixerForFx() ||
+				this->_isTrackBankDirty) {
+			return;
+		}
+		const int numTracks = CSurf_NumTracks(false) + 1;
+		int remaining = PREFETCH_SLOTS_PER_RUN;
+		for (const int bankStart : {this->_trackBankStart - BANK_NUM_SLOTS,
+				this->_trackBankStart + BANK_NUM_SLOTS}) {
+			if (bankStart < 0 || bankStart >= numTracks) {
+				continue;
+			}
+			TrackBankSnapshot& snap = this->_getBankSnapshot(bankStart);
+			const int bankEnd = min(bankStart + BANK_NUM_SLOTS, numTracks);
+			for (int id = bankStart; id < bankEnd && remaining > 0; ++id) {
+				const int numInBank = id - bankStart;
+				// Snapshots are invalidated when the track list changes, so a valid
+				// slot still has the right track.
+				if (snap.valid[numInBank]) {
+					continue;
+				}
+				MediaTrack* track = CSurf_TrackFromID(id, false);
+				if (!track) {
+					break;
+				}
+				this->_updateBankSnapshot(snap, numInBank, track);
+				--remaining;
+			}
+		}
+		// Keep the current bank the most recently used, so that the next neighbour
+		// we fetch replaces the bank furthest away rather than this one.
+		this->_getBankSnapshot(this->_trackBankStart);
+	}
+
+	// Query REAPER for the state of a track in a bank.
+	void _updateBankSnapshot(TrackBankSnapshot& snap, int numInBank,
+		MediaTrack* track
+	) {
+		snap.track[numInBank] = track;
+		snap.selected[numInBank] =
+			*(int*)GetSetMediaTrackInfo(track, "I_SELECTED", nullptr) != 0;
+		snap.soloed[numInBank] =
+			*(int*)GetSetMediaTrackInfo(track, "I_SOLO", nullptr) != 0;
+		snap.muted[numInBank] =
+			*(bool*)GetSetMediaTrackInfo(track, "B_MUTE", nullptr);
+		snap.armed[numInBank] =
+			*(int*)GetSetMediaTrackInfo(track, "I_RECARM", nullptr) != 0;
+		const double volume =
+			*(double*)GetSetMediaTrackInfo(track, "D_VOL", nullptr);
+		snap.volume[numInBank] = volume;
+		char text[64];
+		mkvolstr(text, volume);
+		snap.volumeText[numInBank] = text;
+		const double pan = *(double*)GetSetMediaTrackInfo(track, "D_PAN", nullptr);
+		snap.pan[numInBank] = pan;
+		mkpanstr(text, pan);
+		snap.panText[numInBank] = text;
+		const char* name = (char*)GetSetMediaTrackInfo(track, "P_NAME", nullptr);
+		snap.name[numInBank] = name ? name : "";
+		snap.valid[numInBank] = true;
+	}
+
 	void _onTrackBankSelect(signed char value) {
 		// Manually switch the bank visible in Mixer View WITHOUT influencing track selection
 		int newBankStart = this->_trackBankStart + (value * BANK_NUM_SLOTS);
@@ -656,7 +1315,7 @@ class NiMidiSurface: public BaseSurface {
 	}
 
 	void _onNavigateTracks(bool next) {
-		int id = CSurf_TrackToID(this->_lastSelectedTrack, false);
+		int id = this->_getTrackId(this->_lastSelectedTrack);
 		if (next) {
 			++id;
 		} else {
@@ -671,46 +1330,113 @@ class NiMidiSurface: public BaseSurface {
 		}
 	}
 
-	void _sendCc(unsigned char command, unsigned char value) {
-		if (this->_midiOut) {
-			this->_midiOut->Send(MIDI_CC, command, value, -1);
-		}
+	void _sendCc(unsigned char command, unsigned char value,
+		bool immediate = false
+	) {
+		MIDI_event_t* event = this->_getFrame(3);
+		event->midi_message[0] = MIDI_CC;
+		event->midi_message[1] = command;
+		event->midi_message[2] = value;
+		this->_sendFrame(event, getCcStateKey(command),
+			immediate ? OUT_IMMEDIATE : OUT_FEEDBACK);
 	}
 
 	void _sendSysex(unsigned char command, unsigned char value,
-		unsigned char track, const string& info = ""
+		unsigned char track, string_view info = ""
 	) {
-		if (!this->_midiOut) {
-			return;
-		}
 		int length = sizeof(MIDI_SYSEX_BEGIN)
 			+ 3 // command, value, track
 			+ info.length()
 			+ sizeof(MIDI_SYSEX_END);
-		// MIDI_event_t includes 4 bytes for the message, but we need more.
-		MIDI_event_t* event = (MIDI_event_t*)new unsigned char[
-			sizeof(MIDI_event_t) - 4 + length];
-		event->frame_offset = 0;
-		event->size = length;
+		MIDI_event_t* event = this->_getFrame(length);
 		memcpy(event->midi_message, MIDI_SYSEX_BEGIN,
 			sizeof(MIDI_SYSEX_BEGIN));
 		int messagePos = sizeof(MIDI_SYSEX_BEGIN);
 		event->midi_message[messagePos++] = command;
 		event->midi_message[messagePos++] = value;
 		event->midi_message[messagePos++] = track;
-		memcpy(event->midi_message + messagePos, info.c_str(), info.length());
+		memcpy(event->midi_message + messagePos, info.data(), info.length());
 		messagePos += info.length();
 		event->midi_message[messagePos++] = MIDI_SYSEX_END;
-		this->_midiOut->SendMsg(event, -1);
-		delete event;
+		this->_sendFrame(event, getSysexStateKey(command, track),
+			getSysexPriority(command));
 	}
 
-	int _getNumInBank(MediaTrack* track) {
-		const int id = CSurf_TrackToID(track, false);
-		if (this->_trackBankStart <= id && id < this->_trackBankStart + BANK_NUM_SLOTS) {
-			return id % BANK_NUM_SLOTS;
+	void _getResetKeys(const MIDI_event_t* event, vector<uint32_t>& keys) final {
+		SysexFrame frame;
+		if (event->midi_message[0] != MIDI_SYSEX_BEGIN[0] ||
+				!parseSysex({event->midi_message, (size_t)event->size}, frame)) {
+			return;
+		}
+		const unsigned char track = frame.index;
+		// Some messages change other state on the device, so we can no longer be
+		// sure what it shows.
+		switch (frame.command) {
+			case CMD_TRACK_AVAIL:
+				// Changing the availability of a slot might reset it.
+				for (unsigned char c = CMD_TRACK_SELECTED; c <= CMD_TRACK_VU; ++c) {
+					keys.push_back(getSysexStateKey(c, track));
+				}
+				keys.push_back(getCcStateKey(CMD_KNOB_VOLUME0 + track));
+				keys.push_back(getCcStateKey(CMD_KNOB_PAN0 + track));
+				break;
+			case CMD_PARAM_NAME:
+				// A different parameter might have been assigned to this slot.
+				keys.push_back(getSysexStateKey(CMD_PARAM_VALUE_TEXT, track));
+				keys.push_back(getSysexStateKey(CMD_PARAM_SECTION, track));
+				keys.push_back(getCcStateKey(CMD_KNOB_PARAM0 + track));
+				break;
+			case CMD_SELECT_PLUGIN:
+			case CMD_SEL_TRACK_PARAMS_CHANGED:
+				// The device resets its parameter pages, even if the same plug-in is
+				// selected again.
+				for (unsigned char slot = 0; slot < BANK_NUM_SLOTS; ++slot) {
+					keys.push_back(getSysexStateKey(CMD_PARAM_NAME, slot));
+					keys.push_back(getSysexStateKey(CMD_PARAM_VALUE_TEXT, slot));
+					keys.push_back(getSysexStateKey(CMD_PARAM_SECTION, slot));
+					keys.push_back(getCcStateKey(CMD_KNOB_PARAM0 + slot));
+				}
+				keys.push_back(getSysexStateKey(CMD_PARAM_PAGE, 0));
+				keys.push_back(getSysexStateKey(CMD_PRESET_NAME, 0));
+				keys.push_back(getCcStateKey(CMD_NAV_PRESET));
+				break;
+			case CMD_TRACK_SELECTED:
+				if (frame.value) {
+					// Selecting a track deselects the others on the device.
+					for (unsigned char slot = 0; slot < BANK_NUM_SLOTS; ++slot) {
+						if (slot != track) {
+							keys.push_back(getSysexStateKey(CMD_TRACK_SELECTED, slot));
+						}
+					}
+				}
+				break;
 		}
-		return -1;
+	}
+
+	int _getTrackId(MediaTrack* track) {
+		if (this->_trackIdsDirty) {
+			this->_trackIdsDirty = false;
+			this->_trackIds.clear();
+			// CSurf_NumTracks doesn't count the master, which is id 0.
+			const int numTracks = CSurf_NumTracks(false) + 1;
+			this->_trackIds.reserve(numTracks);
+			for (int id = 0; id < numTracks; ++id) {
+				if (MediaTrack* t = CSurf_TrackFromID(id, false)) {
+					this->_trackIds.emplace(t, id);
+				}
+			}
+		}
+		auto it = this->_trackIds.find(track);
+		if (it != this->_trackIds.end()) {
+			return it->second;
+		}
+		// We haven't been told about this track yet.
+		return CSurf_TrackToID(track, false);
+	}
+
+	bool _isInTrackBank(int id) {
+		return this->_trackBankStart <= id &&
+			id < this->_trackBankStart + BANK_NUM_SLOTS;
 	}
 
 	MediaTrack* _getTrackFromNumInBank(unsigned char numInBank) {
@@ -774,6 +1500,12 @@ class NiMidiSurface: public BaseSurface {
 
 	void _fxChanged(bool shouldOutputOsaraMessage = true) {
 		this->_fxMap = FxMap(this->_lastSelectedTrack, this->_selectedFx);
+		// FX might have been added, removed or reordered, so a cached FX index
+		// might now refer to a different FX.
+		for (FormattedValue& cached : this->_paramTexts) {
+			cached.valid = false;
+		}
+		this->_selectedFxParamInfo = nullptr;
 		if (this->_protocolVersion >= 4) {
 			this->_sendSelectPlugin();
 		} else if (shouldOutputOsaraMessage && osara_outputMessage) {
@@ -808,6 +1540,92 @@ class NiMidiSurface: public BaseSurface {
 			string(subIndexes.rbegin(), subIndexes.rend()));
 	}
 
+	FxParamInfo& _getFxParamInfo(int param) {
+		if (!this->_selectedFxParamInfo) {
+			const GUID* guid = this->_lastSelectedTrack ?
+				TrackFX_GetFXGUID(this->_lastSelectedTrack, this->_selectedFx) :
+				nullptr;
+			this->_selectedFxParamInfo = &this->_fxParamInfo[{
+				this->_lastSelectedTrack,
+				guid ? string((const char*)guid, sizeof(GUID)) : ""}];
+			if (!guid) {
+				// We can't tell which FX this is, so don't reuse anything cached for
+				// another FX we couldn't identify.
+				this->_selectedFxParamInfo->clear();
+			}
+		}
+		vector<FxParamInfo>& infos = *this->_selectedFxParamInfo;
+		if ((size_t)param >= infos.size()) {
+			infos.resize(param + 1);
+		}
+		return infos[param];
+	}
+
+	string _getFxParamName(int mapParam, int param) {
+		if (this->_fxMap.hasParamName(mapParam)) {
+			return this->_fxMap.getParamName(mapParam);
+		}
+		FxParamInfo& info = this->_getFxParamInfo(param);
+		if (!info.isNameKnown) {
+			info.name = this->_fxMap.getParamName(mapParam);
+			info.isNameKnown = true;
+		}
+		return info.name;
+	}
+
+	bool _getFxParamIsToggle(int param) {
+		FxParamInfo& info = this->_getFxParamInfo(param);
+		if (!info.isToggleKnown) {
+			info.isToggle = this->_isFxParamToggle(param);
+			info.isToggleKnown = true;
+		}
+		return info.isToggle;
+	}
+
+	// Forget parameter info for FX which are no longer on a track, or for all of
+	// its FX if the track has been deleted.
+	void _pruneFxParamInfo(MediaTrack* track) {
+		vector<string> guids;
+		if (this->_getTrackId(track) >= 0) {
+			const int count = TrackFX_GetCount(track);
+			for (int fx = 0; fx < count; ++fx) {
+				if (const GUID* guid = TrackFX_GetFXGUID(track, fx)) {
+					guids.emplace_back((const char*)guid, sizeof(GUID));
+				}
+			}
+		}
+		if (track == this->_lastSelectedTrack) {
+			// The selected FX might have moved, so look it up again when we next need
+			// it.
+			this->_selectedFxParamInfo = nullptr;
+		}
+		// Entries are sorted by track, so this track's entries are together.
+		auto it = this->_fxParamInfo.lower_bound({track, string()});
+		while (it != this->_fxParamInfo.end() && it->first.first == track) {
+			if (find(guids.begin(), guids.end(), it->first.second) != guids.end()) {
+				++it;
+				continue;
+			}
+			if (&it->second == this->_selectedFxParamInfo) {
+				this->_selectedFxParamInfo = nullptr;
+			}
+			it = this->_fxParamInfo.erase(it);
+		}
+	}
+
+	void _pruneAllFxParamInfo() {
+		this->_isFxParamInfoStale = false;
+		vector<MediaTrack*> tracks;
+		for (const auto& [key, infos] : this->_fxParamInfo) {
+			if (tracks.empty() || tracks.back() != key.first) {
+				tracks.push_back(key.first);
+			}
+		}
+		for (MediaTrack* track : tracks) {
+			this->_pruneFxParamInfo(track);
+		}
+	}
+
 	bool _isFxParamToggle(int param) {
 		bool isToggle = false;
 		TrackFX_GetParameterStepSizes(this->_lastSelectedTrack, this->_selectedFx,
@@ -823,6 +1641,10 @@ class NiMidiSurface: public BaseSurface {
 	}
 
 	void _fxBankChanged(bool shouldOutputOsaraMessage = true) {
+		// We're about to send the current values for the whole page, and pending
+		// values might be for parameters which are no longer shown.
+		this->_pendingFxParams.fill(-1);
+		this->_resetKnobEchoes();
 		const int count = this->_fxMap.getParamCount();
 		int numPages = count / BANK_NUM_SLOTS;
 		if (count % BANK_NUM_SLOTS) {
@@ -867,7 +1689,7 @@ class NiMidiSurface: public BaseSurface {
 				}
 				continue;
 			}
-			const string name = this->_fxMap.getParamName(mp);
+			const string name = this->_getFxParamName(mp, rp);
 			if (isMixer) {
 				this->_sendSysex(CMD_TRACK_AVAIL, TRTYPE_UNSPEC, numInBank);
 				this->_sendSysex(CMD_TRACK_NAME, 0, numInBank, name);
@@ -876,7 +1698,7 @@ class NiMidiSurface: public BaseSurface {
 				this->_sendSysex(CMD_TRACK_MUTED, 0, numInBank);
 				this->_sendSysex(CMD_TRACK_ARMED, 0, numInBank);
 			} else {
-				const bool isToggle = this->_isFxParamToggle(rp);
+				const bool isToggle = this->_getFxParamIsToggle(rp);
 				this->_sendSysex(CMD_PARAM_NAME,
 					isToggle ? PARAM_VIS_SWITCH : PARAM_VIS_UNIPOLAR, numInBank, name);
 				string section = this->_fxMap.getSection(mp);
@@ -899,20 +1721,109 @@ class NiMidiSurface: public BaseSurface {
 
 	void _fxParamValueChanged(int param, int numInBank, double value) {
 		const bool isMixer = this->_isUsingMixerForFx();
-		unsigned char command = isMixer ? CMD_KNOB_VOLUME0 : CMD_KNOB_PARAM0;
-		this->_sendCc(command + numInBank,127 * value); 
-		char valText[100] = "";
-		TrackFX_FormatParamValueNormalized(this->_lastSelectedTrack,
-			this->_selectedFx, param, value, valText, sizeof(valText));
-		command = isMixer ? CMD_TRACK_VOLUME_TEXT : CMD_PARAM_VALUE_TEXT;
-		this->_sendSysex(command, 0, numInBank, valText);
+		const string& valText = this->_formatFxParam(numInBank, param, value);
+		this->_sendKnobFeedback(
+			(isMixer ? CMD_KNOB_VOLUME0 : CMD_KNOB_PARAM0) + numInBank, 127 * value,
+			isMixer ? CMD_TRACK_VOLUME_TEXT : CMD_PARAM_VALUE_TEXT, numInBank,
+			valText);
 		if (osara_outputMessage && isMixer && param == this->_lastChangedFxParam &&
 				this->_lastFxParamValueOsara != valText) {
-			osara_outputMessage(valText);
+			osara_outputMessage(valText.c_str());
 			this->_lastFxParamValueOsara = valText;
 		}
 	}
 
+	const string& _formatFxParam(int numInBank, int param, double value) {
+		FormattedValue& cached = this->_paramTexts[numInBank];
+		if (!cached.isFor(this->_lastSelectedTrack, this->_selectedFx, param,
+				value)) {
+			char text[100] = "";
+			TrackFX_FormatParamValueNormalized(this->_lastSelectedTrack,
+				this->_selectedFx, param, value, text, sizeof(text));
+			cached.set(this->_lastSelectedTrack, this->_selectedFx, param, value,
+				text);
+		}
+		return cached.text;
+	}
+
+	// Called when we change the value for a knob.
+	void _onKnobChanged(unsigned char knobCommand) {
+		KnobEcho& echo = this->_knobEchoes[knobCommand];
+		echo.isSuppressing = true;
+		echo.changeTime = GetTickCount();
+	}
+
+	// Send a value reported by REAPER for a knob: the knob's position and the
+	// value text. If we changed the value ourselves, the keyboard already shows
+	// the position, so we send it later and only send the text occasionally.
+	void _sendKnobFeedback(unsigned char knobCommand, unsigned char value,
+		unsigned char textCommand, unsigned char numInBank, string_view text
+	) {
+		KnobEcho& echo = this->_knobEchoes[knobCommand];
+		if (!echo.isSuppressing) {
+			this->_sendCc(knobCommand, value);
+			this->_sendSysex(textCommand, 0, numInBank, text);
+			return;
+		}
+		echo.pendingCc = value;
+		const DWORD now = GetTickCount();
+		if (now - echo.textTime >= KNOB_ECHO_TEXT_INTERVAL) {
+			echo.textTime = now;
+			echo.hasPendingText = false;
+			this->_sendSysex(textCommand, 0, numInBank, text);
+			return;
+		}
+		echo.hasPendingText = true;
+		echo.textCommand = textCommand;
+		echo.numInBank = numInBank;
+		echo.pendingText = text;
+	}
+
+	// Send value text which was held back while knobs were being turned, as well
+	// as the final positions of knobs which are no longer being turned.
+	void _sendKnobEchoes(DWORD now) {
+		for (int command = 0; command < (int)this->_knobEchoes.size(); ++command) {
+			KnobEcho& echo = this->_knobEchoes[command];
+			if (!echo.isSuppressing) {
+				continue;
+			}
+			const bool isDone = now - echo.changeTime >= KNOB_ECHO_WINDOW;
+			if (echo.hasPendingText &&
+					(isDone || now - echo.textTime >= KNOB_ECHO_TEXT_INTERVAL)) {
+				echo.textTime = now;
+				echo.hasPendingText = false;
+				this->_sendSysex(echo.textCommand, 0, echo.numInBank,
+					echo.pendingText);
+			}
+			if (!isDone) {
+				continue;
+			}
+			echo.isSuppressing = false;
+			if (echo.pendingCc != -1) {
+				this->_sendCc(command, echo.pendingCc);
+				echo.pendingCc = -1;
+			}
+		}
+	}
+
+	// The knobs are about to show different tracks or parameters, so anything we
+	// held back for them no longer applies.
+	void _resetKnobEchoes() {
+		this->_knobEchoes.fill(KnobEcho());
+	}
+
+	void _sendPendingFxParams() {
+		for (int numInBank = 0; numInBank < BANK_NUM_SLOTS; ++numInBank) {
+			const int param = this->_pendingFxParams[numInBank];
+			if (param == -1) {
+				continue;
+			}
+			this->_pendingFxParams[numInBank] = -1;
+			this->_fxParamValueChanged(param, numInBank,
+				this->_pendingFxParamValues[numInBank]);
+		}
+	}
+
 	void _navigateFxBanks(bool next) {
 		int newBankStart = this->_fxBankStart;
 		if (next) {
@@ -980,6 +1891,8 @@ class NiMidiSurface: public BaseSurface {
 		}
 		val += change * this->_fxMap.getParamMultiplier(mp);
 		val = clamp(val, 0.0, 1.0);
+		this->_onKnobChanged((this->_isUsingMixerForFx() ?
+			CMD_KNOB_VOLUME0 : CMD_KNOB_PARAM0) + numInBank);
 		TrackFX_SetParamNormalized(this->_lastSelectedTrack, this->_selectedFx, param,
 			val);
 		this->_lastChangedFxParam = param;
@@ -1042,23 +1955,19 @@ class NiMidiSurface: public BaseSurface {
 	}
 
 	void _changeParamHighRes(unsigned char group, unsigned char index,
-		const unsigned char lsb, const unsigned char msb
+		double change
 	) {
-		double change = lsb + (msb << 7);
-		if (change > 8192) {
-			// Convert to signed value.
-			change -= 16384;
-		}
-		change /= 8191.0;
 		switch (group) {
 			case PARAM_GROUP_VOLUME:
 				if (MediaTrack* track = this->_getTrackFromNumInBank(index)) {
+					this->_onKnobChanged(CMD_KNOB_VOLUME0 + index);
 					CSurf_SetSurfaceVolume(track, CSurf_OnVolumeChange(track, change, true),
 						nullptr);
 				}
 				break;
 			case PARAM_GROUP_PAN:
 				if (MediaTrack* track = this->_getTrackFromNumInBank(index)) {
+					this->_onKnobChanged(CMD_KNOB_PAN0 + index);
 					CSurf_SetSurfacePan(track, CSurf_OnPanChange(track, change, true),
 						nullptr);
 				}
@@ -1198,6 +2107,68 @@ class NiMidiSurface: public BaseSurface {
 	}
 };
 
+constexpr DispatchTable<NiMidiSurface::CcHandler> makeCcDispatch() {
+	using S = NiMidiSurface;
+	constexpr CommandRange<S::CcHandler> ranges[] = {
+		{CMD_HELLO, 1, &S::_onHello},
+		{CMD_BANK_MAPPING, 1, &S::_onBankMapping},
+		{CMD_PLAY, 1, &S::_onPlay},
+		{CMD_RESTART, 1, &S::_onRestart},
+		{CMD_REC, 1, &S::_onRec},
+		{CMD_COUNT, 1, &S::_onCount},
+		{CMD_STOP, 1, &S::_onStop},
+		{CMD_PLAY_CLIP, 1, &S::_onPlayClip},
+		{CMD_LOOP, 1, &S::_runAction<1068>}, // Transport: Toggle repeat
+		{CMD_METRO, 1, &S::_runAction<40364>}, // Options: Toggle metronome
+		{CMD_TEMPO, 1, &S::_runAction<1134>}, // Transport: Tap tempo
+		{CMD_UNDO, 1, &S::_runAction<40029>}, // Edit: Undo
+		{CMD_REDO, 1, &S::_runAction<40030>}, // Edit: Redo
+		// Track: Toggle MIDI input quantize for selected tracks
+		{CMD_QUANTIZE, 1, &S::_runAction<42033>},
+		{CMD_NAV_TRACKS, 1, &S::_onNavTracks},
+		{CMD_NAV_BANKS, 1, &S::_onNavBanks},
+		{CMD_NAV_CLIPS, 1, &S::_onNavClips},
+		{CMD_MOVE_TRANSPORT, 1, &S::_onMoveTransport},
+		{CMD_NAV_PRESET, 1, &S::_onNavPreset},
+		{CMD_TRACK_SELECTED, 1, &S::_onTrackSelected},
+		{CMD_TRACK_MUTED, 1, &S::_onTrackMuted},
+		{CMD_TRACK_SOLOED, 1, &S::_onTrackSoloed},
+		{CMD_TOGGLE_MUTE, 1, &S::_onToggleMute},
+		{CMD_TOGGLE_SOLO, 1, &S::_onToggleSolo},
+	};
+	return makeDispatchTable(ranges);
+}
+
+constexpr DispatchTable<NiMidiSurface::CcHandler> NiMidiSurface::CC_DISPATCH =
+	makeCcDispatch();
+
+constexpr DispatchTable<NiMidiSurface::CcDeltaHandler> makeCcDeltaDispatch() {
+	using S = NiMidiSurface;
+	constexpr CommandRange<S::CcDeltaHandler> ranges[] = {
+		{CMD_KNOB_VOLUME0, BANK_NUM_SLOTS, &S::_onKnobVolume},
+		{CMD_KNOB_PAN0, BANK_NUM_SLOTS, &S::_onKnobPan},
+		{CMD_CHANGE_VOLUME, 1, &S::_onChangeVolume},
+		{CMD_CHANGE_PAN, 1, &S::_onChangePan},
+	};
+	return makeDispatchTable(ranges);
+}
+
+constexpr DispatchTable<NiMidiSurface::CcDeltaHandler>
+	NiMidiSurface::CC_DELTA_DISPATCH = makeCcDeltaDispatch();
+
+constexpr DispatchTable<NiMidiSurface::SysexHandler> makeSysexDispatch() {
+	using S = NiMidiSurface;
+	constexpr CommandRange<S::SysexHandler> ranges[] = {
+		{CMD_SET_TEMPO, 1, &S::_onSetTempo},
+		{CMD_SELECT_PLUGIN, 1, &S::_onSelectPlugin},
+		{CMD_PARAM_HIGH_RES, 1, &S::_onParamHighRes},
+	};
+	return makeDispatchTable(ranges);
+}
+
+constexpr DispatchTable<NiMidiSurface::SysexHandler>
+	NiMidiSurface::SYSEX_DISPATCH = makeSysexDispatch();
+
 IReaperControlSurface* createNiMidiSurface(int inDev, int outDev) {
 	return new NiMidiSurface(inDev, outDev);
 }
@@ -0,0 +1,26 @@
+/*
+ * ReaKontrol
+ * Sysex framing for the Komplete Kontrol MIDI protocol code
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <cstring>
+#include "niSysex.h"
+
+using namespace std;
+
+bool parseSysex(span<const unsigned char> message, SysexFrame& frame) {
+	if (message.size() < SYSEX_OVERHEAD ||
+			memcmp(message.data(), MIDI_SYSEX_BEGIN, sizeof(MIDI_SYSEX_BEGIN)) != 0 ||
+			message.back() != MIDI_SYSEX_END) {
+		return false;
+	}
+	const auto body = message.subspan(sizeof(MIDI_SYSEX_BEGIN));
+	frame.command = body[0];
+	frame.value = body[1];
+	frame.index = body[2];
+	frame.info = body.subspan(3, body.size() - 3 - sizeof(MIDI_SYSEX_END));
+	return true;
+}
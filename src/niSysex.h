@@ -0,0 +1,34 @@
+/*
+ * ReaKontrol
+ * Sysex framing for the Komplete Kontrol MIDI protocol header
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+inline constexpr unsigned char MIDI_SYSEX_BEGIN[] = {
+	0xF0, 0x00, 0x21, 0x09, 0x00, 0x00, 0x44, 0x43, 0x01, 0x00};
+inline constexpr unsigned char MIDI_SYSEX_END = 0xF7;
+
+// A sysex message from the device. info refers to the bytes in the original
+// message between the index and the sysex suffix.
+struct SysexFrame {
+	unsigned char command;
+	unsigned char value;
+	unsigned char index;
+	std::span<const unsigned char> info;
+};
+
+// The number of bytes in a sysex message other than the info.
+inline constexpr size_t SYSEX_OVERHEAD = sizeof(MIDI_SYSEX_BEGIN)
+	+ 3 // command, value, index
+	+ sizeof(MIDI_SYSEX_END);
+
+// Decode a sysex message from the device without copying it. Returns false if
+// the message is too short, isn't for us or isn't terminated.
+bool parseSysex(std::span<const unsigned char> message, SysexFrame& frame);
@@ -0,0 +1,117 @@
+/*
+ * ReaKontrol
+ * MIDI output thread code
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include "outputThread.h"
+#include "reaKontrol.h"
+
+// The ring buffer size. This is many times more than a track bank change, so
+// it only fills if the driver is very slow.
+constexpr size_t RING_SIZE = 64 * 1024;
+// The timestamp of a marker message which tells the thread to send the
+// oversized message instead.
+constexpr uint64_t SEND_OVERSIZED = 1;
+
+OutputThread::OutputThread(midi_Output* output)
+: _output(output), _ring(RING_SIZE) {
+	this->_thread = std::thread(&OutputThread::_run, this);
+}
+
+OutputThread::~OutputThread() {
+	this->drain();
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		this->_stop = true;
+	}
+	this->_workCond.notify_one();
+	this->_thread.join();
+}
+
+bool OutputThread::push(const MIDI_event_t* event) {
+	if (!this->_ring.canFit(event)) {
+		// This will never fit in the ring. Rather than waiting for the thread to
+		// finish so we can send it ourselves, copy it aside and queue a marker in
+		// its place. If the last oversized message hasn't been sent yet, the
+		// caller must try again later.
+		if (this->_isOversizedPending) {
+			++this->_overflows;
+			return false;
+		}
+		const auto data = (const unsigned char*)event;
+		this->_oversized.assign(data,
+			data + sizeof(MIDI_event_t) - 4 + event->size);
+		// Set this before the marker is visible, since the thread clears it.
+		this->_isOversizedPending = true;
+		MIDI_event_t marker {};
+		marker.size = 1;
+		if (!this->_ring.push(&marker, SEND_OVERSIZED)) {
+			this->_isOversizedPending = false;
+			++this->_overflows;
+			return false;
+		}
+		this->_wake();
+		return true;
+	}
+	if (!this->_ring.push(event)) {
+		++this->_overflows;
+		return false;
+	}
+	this->_wake();
+	return true;
+}
+
+void OutputThread::drain() {
+	std::unique_lock<std::mutex> lock(this->_mutex);
+	this->_idleCond.wait(lock, [this] { return this->_ring.isEmpty(); });
+}
+
+OutputThread::Stats OutputThread::getStats() const {
+	return {this->_sentMessages, this->_sentBytes, this->_overflows,
+		this->_ring.getMaxUsed()};
+}
+
+void OutputThread::_wake() {
+	// Taking the lock means the thread is either about to check the ring, in
+	// which case it will see this message, or already waiting, in which case it
+	// will get the notification.
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+	}
+	this->_workCond.notify_one();
+}
+
+void OutputThread::_send(MIDI_event_t* event) {
+	this->_output->SendMsg(event, -1);
+	++this->_sentMessages;
+	this->_sentBytes += event->size;
+}
+
+void OutputThread::_run() {
+	for (; ;) {
+		uint64_t time;
+		MIDI_event_t* event = this->_ring.front(&time);
+		if (!event) {
+			std::unique_lock<std::mutex> lock(this->_mutex);
+			this->_idleCond.notify_all();
+			this->_workCond.wait(lock, [this] {
+				return this->_stop || !this->_ring.isEmpty();
+			});
+			if (this->_stop && this->_ring.isEmpty()) {
+				return;
+			}
+			continue;
+		}
+		if (time == SEND_OVERSIZED) {
+			this->_send((MIDI_event_t*)this->_oversized.data());
+			this->_isOversizedPending = false;
+		} else {
+			this->_send(event);
+		}
+		// Let the producer reuse this space.
+		this->_ring.pop();
+	}
+}
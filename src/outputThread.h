@@ -0,0 +1,71 @@
+/*
+ * ReaKontrol
+ * MIDI output thread header
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "midiRing.h"
+
+// Sends MIDI messages to a midi_Output on a dedicated thread, so that a slow
+// driver doesn't stall REAPER's main thread. Messages are passed to the thread
+// through a fixed size, lock-free, single producer, single consumer ring
+// buffer. The thread sleeps on a condition variable while the buffer is empty.
+// Only one thread may call push and drain.
+class OutputThread {
+	public:
+	OutputThread(midi_Output* output);
+	// Waits for queued messages to be sent before stopping the thread.
+	~OutputThread();
+	// Queue a message to be sent. Returns false if there isn't enough room in
+	// the buffer, in which case the caller should try again later. This never
+	// waits for the thread.
+	bool push(const MIDI_event_t* event);
+	// Wait until all queued messages have been sent.
+	void drain();
+
+	struct Stats {
+		uint64_t sentMessages;
+		uint64_t sentBytes;
+		// The number of times push failed because the buffer was full or an
+		// oversized message was still waiting to be sent.
+		uint64_t overflows;
+		// The most bytes that have been waiting in the buffer at once.
+		size_t maxUsed;
+	};
+	Stats getStats() const;
+
+	private:
+	void _run();
+	void _send(MIDI_event_t* event);
+	// Wake the thread after pushing a message.
+	void _wake();
+
+	midi_Output* _output;
+	MidiRing _ring;
+	// A message too big for the ring. Its place in the ring is held by a small
+	// marker message, so it is still sent in order.
+	std::vector<unsigned char> _oversized;
+	// Whether _oversized is waiting to be sent. Only the thread clears this.
+	std::atomic<bool> _isOversizedPending = false;
+	// Protects waiting on the condition variables below.
+	std::mutex _mutex;
+	// Notified when a message is pushed or the thread should stop.
+	std::condition_variable _workCond;
+	// Notified when the thread has sent everything in the ring.
+	std::condition_variable _idleCond;
+	std::atomic<bool> _stop = false;
+	std::atomic<uint64_t> _sentMessages = 0;
+	std::atomic<uint64_t> _sentBytes = 0;
+	uint64_t _overflows = 0;
+	std::thread _thread;
+};
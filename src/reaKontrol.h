@@ -8,7 +8,14 @@
 
 #pragma once
 
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #define REAPERAPI_MINIMAL
 #define REAPERAPI_WANT_GetNumMIDIInputs
@@ -22,9 +29,7 @@
 #define REAPERAPI_WANT_CSurf_TrackToID
 #define REAPERAPI_WANT_CSurf_TrackFromID
 #define REAPERAPI_WANT_CSurf_OnPlay
-#ifdef LOGGING
 #define REAPERAPI_WANT_ShowConsoleMsg
-#endif
 #define REAPERAPI_WANT_TrackFX_GetCount
 #define REAPERAPI_WANT_TrackFX_GetFXName
 #define REAPERAPI_WANT_TrackFX_GetParamName
@@ -65,8 +70,18 @@
 #define REAPERAPI_WANT_projectconfig_var_addr
 #define REAPERAPI_WANT_plugin_getapi
 #define REAPERAPI_WANT_GetResourcePath
+#define REAPERAPI_WANT_GetExtState
+#define REAPERAPI_WANT_SetExtState
+#define REAPERAPI_WANT_GetUserFileNameForRead
+#define REAPERAPI_WANT_ShowMessageBox
+#define REAPERAPI_WANT_GetMainHwnd
+#define REAPERAPI_WANT_Track_GetPeakInfo
+#define REAPERAPI_WANT_TrackFX_GetFXGUID
 #include <reaper/reaper_plugin.h>
 #include <reaper/reaper_plugin_functions.h>
+#include "inputThread.h"
+#include "latencyHistogram.h"
+#include "outputThread.h"
 
 #ifdef LOGGING
 # include <sstream>
@@ -82,20 +97,205 @@
 constexpr int BANK_NUM_SLOTS = 8;
 
 const std::string getKkInstanceName(MediaTrack* track, bool stripPrefix=false);
+// Get a number from REAPER's extended state for ReaKontrol, or defaultValue if
+// it isn't set.
+int getIntSetting(const char* key, int defaultValue);
+
+// How urgently an outgoing message should be sent. Queued messages are sent in
+// this order.
+enum OutPriority {
+	// Sent straight away, bypassing the queue. This should only be used for time
+	// critical feedback such as transport lights.
+	OUT_IMMEDIATE,
+	// Lights, knob positions and messages which reset what the device shows.
+	OUT_FEEDBACK,
+	// Value text.
+	OUT_VALUE,
+	// Names and other bulk text.
+	OUT_BULK,
+	OUT_NUM_PRIORITIES,
+};
+
+// Work a surface does later than the input which asked for it, so that a burst
+// of input only does it once. These are in the order the work is done within a
+// Run().
+enum DeferredWork {
+	// Following the selected track.
+	DEFER_SELECTION,
+	// Applying the encoder turns received in a Run().
+	DEFER_KNOBS,
+	// Refreshing the mixer bank after the track list changes. This is done at the
+	// start of the next Run().
+	DEFER_BANK_REFRESH,
+	DEFER_NUM_WORK,
+};
 
 class BaseSurface: public IReaperControlSurface {
 	public:
-	BaseSurface(int inDev, int outDev);
+	// maxFrameSize is the size of the largest message the surface's protocol
+	// normally sends. It is used to size the output queue up front, so sending
+	// doesn't allocate.
+	// isUrgentInput is used by the input thread (see InputThread) to decide
+	// whether a message should be handled without waiting for Run(). If it is
+	// null, the surface doesn't use the input thread.
+	BaseSurface(int inDev, int outDev, size_t maxFrameSize,
+		bool (*isUrgentInput)(const MIDI_event_t*) = nullptr);
 	virtual ~BaseSurface();
 	virtual const char* GetConfigString() override {
 		return "";
 	}
 	virtual void Run() override;
+	// Handle input received from the device, without doing the rest of Run().
+	// This is used when the input thread asks the main thread to handle urgent
+	// input straight away.
+	void handleInput();
+	// Feed the messages received from the device in a capture file (see
+	// MidiCapture) through this surface and report how long it took, as well as
+	// how much output was produced compared to the capture. This is intended for
+	// a surface created without devices, in which case output is counted but
+	// not sent.
+	void replayCapture(const std::filesystem::path& path);
+	// Report input latency for each command, as well as output statistics, in
+	// the REAPER console.
+	void dumpPerfStats();
 
 	protected:
 	midi_Input* _midiIn = nullptr;
 	midi_Output* _midiOut = nullptr;
+	// Whether replayCapture is running.
+	bool _isReplaying = false;
 	virtual void _onMidiEvent(MIDI_event_t* event) = 0;
+	// Called after all the events received in a Run() have been passed to
+	// _onMidiEvent.
+	virtual void _onMidiEventsDone() {}
+	// Identify the command in a message from the device, so that performance
+	// statistics can be kept per command. The default is the status byte
+	// followed by the first data byte.
+	virtual uint16_t _getInputStatsKey(const MIDI_event_t* event);
+
+	// Get a frame with room for a message of the given size at the end of the
+	// output queue. The frame must be passed to _sendFrame before another frame
+	// is requested.
+	MIDI_event_t* _getFrame(size_t size);
+	// Messages are queued and sent together at the end of Run(), so a burst of
+	// updates reaches the device at once. Each Run() sends a limited number of
+	// bytes, so that a large burst doesn't delay later, more urgent feedback.
+	// stateKey identifies the device state this message sets; e.g. a command
+	// and slot. A queued message is replaced by a newer message with the same
+	// key. If the last message sent with this key was identical, the device
+	// already shows this state, so the message is dropped. 0 means the message
+	// should always be sent.
+	// Returns false if the message was dropped.
+	bool _sendFrame(MIDI_event_t* event, uint32_t stateKey = 0,
+		OutPriority priority = OUT_FEEDBACK);
+	void _sendRaw(std::string_view message);
+	// Send queued messages until maxBytes have been sent. At least one message
+	// is always sent if there are any queued.
+	void _flushOutput(size_t maxBytes = SIZE_MAX);
+	// Send all queued messages and wait until they have reached the driver.
+	void _drainOutput();
+	// Some messages reset other state on the device; e.g. selecting a plug-in
+	// resets the parameter names. Surfaces override this to add the state keys a
+	// message might reset to keys. When the message is sent, we forget what we
+	// sent for those keys. Queued messages are never replaced by messages queued
+	// after a reset, since the new value would then be sent before the reset,
+	// which might wipe it.
+	virtual void _getResetKeys(const MIDI_event_t* event,
+		std::vector<uint32_t>& keys) {}
+	// Forget all device state; e.g. because the device was reset.
+	void _resetDeviceState();
+	// Call this while handling input whose work has been deferred. Its latency is
+	// then recorded when _finishDeferredWork is called for that work, rather
+	// than when _onMidiEvent returns. If the input defers several kinds of work,
+	// the latency includes all of them. This does nothing if we aren't handling
+	// input; e.g. if REAPER asked for the work.
+	void _deferInput(DeferredWork work);
+	// Call this when deferred work has been done.
+	void _finishDeferredWork(DeferredWork work);
+
+	private:
+	struct QueuedFrame {
+		uint32_t stateKey;
+		// The offset of the frame in _outQueue, or NO_FRAME if the message was
+		// superseded before it was sent.
+		size_t offset;
+		// Whether _getResetKeys returned any keys for this message.
+		bool isReset;
+	};
+	static constexpr size_t NO_FRAME = SIZE_MAX;
+
+	// What we know about the device state for a state key.
+	struct DeviceState {
+		// The last message sent with this key, or empty if we don't know what the
+		// device shows.
+		std::vector<unsigned char> shown;
+		// The number of queued messages which might reset this state.
+		unsigned int pendingResets = 0;
+		// The queue and sequence number (see _outFramesStart) of the last message
+		// queued with this key. queue is -1 if there is none.
+		int queue = -1;
+		uint64_t seq = 0;
+	};
+
+	// Frame storage, packed one after another like a MIDI_eventlist. Replaced
+	// and sent frames are only removed when the queue is compacted in
+	// _flushOutput.
+	std::vector<unsigned char> _outQueue;
+	// Spare storage used when compacting _outQueue.
+	std::vector<unsigned char> _outQueueSpare;
+	// The offset in _outQueue of the frame returned by the last _getFrame call.
+	size_t _frameStart = 0;
+	// The frames waiting to be sent for each priority, in the order they were
+	// queued. Index 0 is OUT_FEEDBACK.
+	std::vector<QueuedFrame> _outFrames[OUT_NUM_PRIORITIES - 1];
+	// Every frame queued for a priority gets the next sequence number. This is
+	// the sequence number of the first frame in each of _outFrames.
+	uint64_t _outFramesStart[OUT_NUM_PRIORITIES - 1] = {};
+	// The sequence number after the last reset or message without a key queued
+	// for each priority. Frames queued before this can't be replaced.
+	uint64_t _outBarrier[OUT_NUM_PRIORITIES - 1] = {};
+	// If the user enabled the output thread, messages are sent on this thread
+	// instead of the main thread.
+	std::unique_ptr<OutputThread> _outputThread;
+	// If the user enabled the input thread, messages are read on this thread
+	// instead of in Run().
+	std::unique_ptr<InputThread> _inputThread;
+	// The input time of the last SwapBufs call when not using the input thread.
+	uint64_t _lastInputSwapTime = 0;
+	// The time from a message arriving until _onMidiEvent finished, or until the
+	// work it deferred was done, keyed by _getInputStatsKey.
+	std::map<uint16_t, LatencyHistogram> _inputLatency;
+	// The message being handled by _handleInput.
+	bool _isHandlingInput = false;
+	uint16_t _inputKey = 0;
+	uint64_t _inputArrivalTime = 0;
+	// The last work deferred by the message being handled, or -1 if none.
+	int _inputDeferral = -1;
+	struct DeferredInput {
+		uint16_t key;
+		uint64_t arrivalTime;
+	};
+	// Messages waiting for each kind of deferred work. These never shrink, so
+	// once they have grown to fit a busy Run(), deferring doesn't allocate.
+	std::vector<DeferredInput> _deferredInputs[DEFER_NUM_WORK];
+	uint64_t _sentMessages = 0;
+	uint64_t _sentBytes = 0;
+
+	void _handleInput(MIDI_event_t* event, uint64_t arrivalTime);
+	// Returns false if the message couldn't be sent yet because the output
+	// thread's buffer is full.
+	bool _send(MIDI_event_t* event);
+	MIDI_event_t* _getQueuedFrame(const QueuedFrame& frame);
+	// Update what we know the device shows after sending a message. wasQueued
+	// is false for messages sent immediately.
+	void _onFrameSent(DeviceState* state, MIDI_event_t* event, bool isReset,
+		bool wasQueued);
+	// Keyed by state key. Entries are never removed, so once a key has been
+	// used, sending with it doesn't allocate.
+	std::unordered_map<uint32_t, DeviceState> _deviceState;
+	// Reused by _sendFrame and _onFrameSent to get reset keys without
+	// allocating.
+	std::vector<uint32_t> _resetKeys;
 };
 
 IReaperControlSurface* createNiMidiSurface(int inDev, int outDev);
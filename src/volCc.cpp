@@ -0,0 +1,35 @@
+/*
+ * ReaKontrol
+ * Fast conversion of volumes to CC values code
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <bit>
+#include <cstdint>
+#include "volCc.h"
+
+using namespace std;
+
+VolCcThresholds makeVolCcThresholds(unsigned char (*volToCcExact)(double)) {
+	VolCcThresholds thresholds {};
+	// We binary search for the volume where each CC value starts. Positive
+	// doubles sort the same way as their bits, so we search the bits to get the
+	// exact threshold. Volumes above 16 (+24 dB) can't be set in REAPER.
+	const uint64_t maxBits = bit_cast<uint64_t>(16.0);
+	for (unsigned char cc = 1; cc < 128; ++cc) {
+		uint64_t low = 0;
+		uint64_t high = maxBits;
+		while (low < high) {
+			const uint64_t mid = low + (high - low) / 2;
+			if (volToCcExact(bit_cast<double>(mid)) >= cc) {
+				high = mid;
+			} else {
+				low = mid + 1;
+			}
+		}
+		thresholds[cc] = bit_cast<double>(low);
+	}
+	return thresholds;
+}
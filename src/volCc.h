@@ -0,0 +1,80 @@
+/*
+ * ReaKontrol
+ * Fast conversion of volumes and pans to CC values header
+ * Author: James Teh <jamie@jantrid.net>
+ * Copyright 2026 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+// For each CC value, the lowest volume which converts to it. Index 0 isn't
+// used.
+using VolCcThresholds = std::array<double, 128>;
+
+// Build the thresholds from an exact, but slow, conversion function. That
+// function must never decrease as the volume increases.
+VolCcThresholds makeVolCcThresholds(unsigned char (*volToCcExact)(double));
+
+inline unsigned char volToCc(const VolCcThresholds& thresholds, double volume) {
+	// Find the highest CC value whose threshold is <= volume. There are no
+	// branches in the loop, so the compiler can unroll it and the CPU doesn't
+	// have to predict anything. Negative volumes convert the same as 0.
+	volume = std::max(volume, 0.0);
+	size_t cc = 0;
+	for (size_t step = 64; step > 0; step /= 2) {
+		cc += (thresholds[cc + step] <= volume) * step;
+	}
+	return (unsigned char)cc;
+}
+
+// Convert several volumes at once; e.g. a whole bank. Each step of a search
+// depends on the step before it, so converting one volume at a time leaves the
+// CPU waiting for each load. Here, each step is done for all the volumes
+// before the next step, so the searches run side by side.
+template<size_t count>
+void volsToCcs(const VolCcThresholds& thresholds,
+	const std::array<double, count>& volumes,
+	std::array<unsigned char, count>& ccs
+) {
+	std::array<double, count> clamped;
+	std::array<size_t, count> found {};
+	for (size_t i = 0; i < count; ++i) {
+		clamped[i] = std::max(volumes[i], 0.0);
+	}
+	for (size_t step = 64; step > 0; step /= 2) {
+		for (size_t i = 0; i < count; ++i) {
+			found[i] += (thresholds[found[i] + step] <= clamped[i]) * step;
+		}
+	}
+	for (size_t i = 0; i < count; ++i) {
+		ccs[i] = (unsigned char)found[i];
+	}
+}
+
+inline unsigned char panToCc(double pan) {
+	// Based on:
+	// https://github.com/justinfrankel/reaper-sdk/blob/cde283eea2d82e19e473062649a95dc0e799fe37/reaper-plugins/reaper_csurf/csurf_01X.cpp#LL295
+	// Pan ranges from -1 to 1, so add 1 to give us a range of 0 to 2. Then
+	// divide by 2 to give us a fraction of 1. Finally, CC values range from 0 to
+	// 127, so multiply to scale accordingly.
+	double val = (pan + 1.0) / 2.0 * 127.0;
+	val = std::clamp(val, 0.0, 127.0);
+	// Round >= 0.5 up to 1.
+	return (unsigned char)(val + 0.5);
+}
+
+// Convert several pans at once. There are no branches or calls, so the
+// compiler can vectorise this.
+template<size_t count>
+void pansToCcs(const std::array<double, count>& pans,
+	std::array<unsigned char, count>& ccs
+) {
+	for (size_t i = 0; i < count; ++i) {
+		ccs[i] = panToCc(pans[i]);
+	}
+}